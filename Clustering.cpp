@@ -1,12 +1,132 @@
 #include "Clustering.h"
 
+#include <QSettings>
+
+#include <algorithm>
+
+#include "Trace.h"
+
 Clustering::Clustering(Qt3DCore::QEntity* parentEntity, QObject* parent) : QObject(parent)
+  , _placementTimer(new QTimer(this))
 {
 	_parentEntity = parentEntity;
 
-	//Signals and slots within the same class, function calls don't work (across threads)
-	QObject::connect(this, &Clustering::requestReserveGroups, this, &Clustering::reserveGroups);
-	QObject::connect(this, &Clustering::requestAddStarInGroup, this, &Clustering::addStarInGroup);
+	_placementTimer->setInterval(PLACEMENT_TICK_INTERVAL);
+	QObject::connect(_placementTimer, &QTimer::timeout, this, &Clustering::placeStars);
+}
+
+Clustering::~Clustering()
+{
+	//Tasks reference the engine and the prepared shells, they must be gone first
+	_cancellation.cancel();
+	for (const TaskHandle& task : qAsConst(_tasks)) TaskScheduler::instance().wait(task);
+}
+
+void Clustering::start()
+{
+	_cancellation.cancel();
+	for (const TaskHandle& task : qAsConst(_tasks)) TaskScheduler::instance().wait(task);
+	_placementTimer->stop();
+
+	_cancellation = CancellationToken();
+	_tasks.clear();
+	_lastPrepareTask = nullptr;
+	for (placementShell& shell : _preparedShells) shell.clear();
+	_preparedShellCount = 0;
+
+	_isNextClusterReady = true;
+	_isPlacing = false;
+	_currentShellIndex = 0;
+	_starsPlaced = 0;
+	_measuredStars = 0.;
+	_measuredGenerationSeconds = 0.;
+	_measuredPlacementSeconds = 0.;
+	_measuredTicks = 0;
+
+	//A resumed run keeps the frustum of its checkpoint
+	if (_engine->resumedShellCount() == 0) _engine->setFrustum(getFrustum());
+
+	//Generation runs on the pool, the GUI thread stays responsive
+	const CancellationToken cancellation = _cancellation;
+	_tasks << TaskScheduler::instance().submit([=]
+	{
+		if (!_engine->generate(cancellation)) qWarning("%s", _engine->error().c_str());
+		if (!cancellation.isCancelled()) QMetaObject::invokeMethod(this, &Clustering::generated, Qt::QueuedConnection);
+	});
+}
+
+void Clustering::setCheckpointPath(const QString& path)
+{
+	_engine->setCheckpointOutput(path.toStdString(), false);
+}
+
+void Clustering::setSightLinesEnabled(const bool enabled)
+{
+	_engine->setSightLineCount(enabled ? SIGHT_LINE_COUNT : 0);
+}
+
+bool Clustering::resume(const QString& path)
+{
+	if (_engine->resumeCheckpoint(path.toStdString())) return true;
+
+	qWarning("%s", _engine->error().c_str());
+	return false;
+}
+
+void Clustering::terminate()
+{
+	_cancellation.cancel();
+	_placementTimer->stop();
+	_isPlacing = false;
+}
+
+void Clustering::setNextClusterReady()
+{
+	_isNextClusterReady = true;
+	QMetaObject::invokeMethod(this, &Clustering::placeNextShell, Qt::QueuedConnection);
+}
+
+QString Clustering::generationThroughputKey(const clusteringMethod method)
+{
+	//Fractal levels expand and cull many more candidates per visible star than Halley shells sample
+	return QString("throughput/%1/generationStarsPerSecond").arg(method == clusteringMethod::HALLEY ? "halley" : "fractal");
+}
+
+Throughput Clustering::measuredThroughput(const clusteringMethod method)
+{
+	const QSettings settings;
+	Throughput throughput;
+	throughput.generationStarsPerSecond = settings.value(generationThroughputKey(method), throughput.generationStarsPerSecond).toDouble();
+	throughput.bulkPlacementStarsPerSecond = settings.value("throughput/bulkPlacementStarsPerSecond", throughput.bulkPlacementStarsPerSecond).toDouble();
+	throughput.placementTickSeconds = settings.value("throughput/placementTickSeconds", throughput.placementTickSeconds).toDouble();
+	return throughput;
+}
+
+double Clustering::estimatedMemory(const RunEstimate& estimate, const bool compact)
+{
+	//Placement arenas of the shell being placed and of the one prepared next
+	const double placementBytes = double(PREPARED_SHELL_SLOTS) * estimate.largestShellStarCount * (sizeof(QVector3D) + sizeof(float));
+	if (compact) return estimate.compactCatalogBytes + estimate.starCount * InstancedStar::COMPACT_BYTES_PER_INSTANCE + placementBytes;
+	return estimate.catalogBytes + estimate.starCount * InstancedStar::BYTES_PER_INSTANCE + placementBytes;
+}
+
+void Clustering::saveThroughput() const
+{
+	//Averaged with the previous runs, tiny runs are mostly overhead and aren't stored
+	constexpr double MIN_MEASURED_STARS = 1000.;
+	constexpr int MIN_MEASURED_TICKS = 100;
+
+	QSettings settings;
+	auto store = [&](const QString& key, const double value)
+	{
+		const double previous = settings.value(key, 0.).toDouble();
+		settings.setValue(key, previous > 0. ? (previous + value) / 2. : value);
+	};
+
+	if (_measuredStars < MIN_MEASURED_STARS) return;
+	if (_measuredGenerationSeconds > 0.) store(generationThroughputKey(_engine->parameters().method), _measuredStars / _measuredGenerationSeconds);
+	if (_placementMode == placementMode::BULK && _measuredPlacementSeconds > 0.) store("throughput/bulkPlacementStarsPerSecond", _measuredStars / _measuredPlacementSeconds);
+	if (_placementMode == placementMode::ANIMATED && _measuredTicks >= MIN_MEASURED_TICKS) store("throughput/placementTickSeconds", _measuredPlacementSeconds / _measuredTicks);
 }
 
 void Clustering::setCameraProjectionMatrix(const QMatrix4x4& projectionMatrix, const QMatrix4x4& viewMatrix, const QRect& rect)
@@ -22,31 +142,232 @@ void Clustering::setStarProperties(const float size, const float powerFactor)
 	_starPowerFactor = powerFactor;
 }
 
-bool Clustering::isPointVisible(const QVector3D& point)
+Frustum Clustering::getFrustum() const
+{
+	const QMatrix4x4 viewProjectionMatrix = _projectionMatrix * _viewMatrix;
+	return Frustum(viewProjectionMatrix.constData());
+}
+
+void Clustering::placementShell::clear()
+{
+	stars.clear();
+	scales.clear();
+	groups.clear();
+}
+
+void Clustering::distributeStarsInGroups(const int shellIndex, placementShell& outShell, const CancellationToken& cancellation) const
+{
+	OLBERS_TRACE_SCOPE("prepare shell", "placement");
+	const int starCount = _engine->storedStarCount(shellIndex);
+
+	//Stars further than this, after the distance scaling, cover less than IMPOSTOR_PIXEL_RADIUS
+	const float focalLength = _projectionMatrix(1, 1) * _viewportRect.height() / 2.f;
+	const float impostorDistance = _impostorsEnabled ? _starSize * focalLength / IMPOSTOR_PIXEL_RADIUS : INFINITY;
+
+	//Capacity is kept from the shell this slot held before
+	outShell.clear();
+	outShell.stars.resize(starCount);
+	outShell.scales.resize(starCount);
+
+	const int groupSize = _placementMode == placementMode::BULK ? qMax(starCount, 1) : fmax(floor(starCount / QThread::idealThreadCount()), STARS_PER_GROUP);
+	for (int begin = 0; begin < starCount; begin += groupSize)
+	{
+		if (cancellation.isCancelled()) return;
+
+		//Spheres fill the group's range from the front, impostors from the back and are reversed into order afterwards
+		const int end = qMin(begin + groupSize, starCount);
+		int sphereEnd = begin;
+		int impostorBegin = end;
+		placementGroup group;
+		std::fill(group.minDistance, group.minDistance + STAR_LOD_COUNT, INFINITY);
+		_engine->forEachStar(shellIndex, begin, end, [&](const double x, const double y, const double z)
+		{
+			//The camera sits at the observer, so observer-relative positions are camera-relative. Resolved in double first
+			const QVector3D location(float(x), float(y), float(z));
+			const float distance = location.length();
+			const float scale = 1.f / pow(distance, _starPowerFactor);
+			const starLod lod = distance * scale > impostorDistance ? starLod::IMPOSTOR : starLod::SPHERE;
+			const int star = lod == starLod::IMPOSTOR ? --impostorBegin : sphereEnd++;
+			outShell.stars[star] = location;
+			outShell.scales[star] = scale;
+			group.minDistance[lod] = qMin(group.minDistance[lod], distance * scale);
+			group.maxDistance[lod] = qMax(group.maxDistance[lod], distance * scale);
+		});
+		std::reverse(outShell.stars.begin() + impostorBegin, outShell.stars.begin() + end);
+		std::reverse(outShell.scales.begin() + impostorBegin, outShell.scales.begin() + end);
+
+		group.begin[starLod::SPHERE] = begin;
+		group.count[starLod::SPHERE] = sphereEnd - begin;
+		group.begin[starLod::IMPOSTOR] = impostorBegin;
+		group.count[starLod::IMPOSTOR] = end - impostorBegin;
+		outShell.groups << group;
+	}
+}
+
+void Clustering::generated()
 {
-	const QVector3D projected = point.project(_viewMatrix, _projectionMatrix, _viewportRect);
-	return projected.z() > 0 && projected.z() < 1 && projected.x() > 0 && projected.x() < _viewportRect.x() + _viewportRect.width() && projected.y() > 0 && projected.y() < _viewportRect.y() + _viewportRect.height();
+	//Shells restored from a checkpoint only have their results
+	_currentShellIndex = _engine->resumedShellCount();
+	_preparedShellCount = _currentShellIndex;
+	for (int shellIndex = 0; shellIndex < _currentShellIndex; shellIndex++) addShellResult(shellIndex);
+	if (_currentShellIndex > 0) _starsPlaced = _engine->flux().cumulativeStarCount(_currentShellIndex - 1);
+
+	//Sampled shells only place their sample
+	_totalStarCount = _starsPlaced;
+	for (int shellIndex = _currentShellIndex; shellIndex < _engine->shellCount(); shellIndex++) _totalStarCount += _engine->storedStarCount(shellIndex);
+
+	if (_currentShellIndex == _engine->shellCount())
+	{
+		emit finished();
+		return;
+	}
+	prepareShell(_currentShellIndex);
 }
 
-QList<Clustering::threadGroup*> Clustering::distributeStarsInThreads(const QList<QVector3D>& stars)
+void Clustering::prepareShell(const int shellIndex)
 {
-	QList<Clustering::threadGroup*> groups;
-	const int groupSize = fmax(floor(stars.size() / QThread::idealThreadCount()), STARS_PER_THREAD);
-	const int fullGroupCount = floor(stars.size() / groupSize);
-	for (int groupIndex = 0; groupIndex < fullGroupCount; groupIndex++)
+	if (shellIndex >= _engine->shellCount()) return;
+
+	const CancellationToken cancellation = _cancellation;
+	_lastPrepareTask = TaskScheduler::instance().submit([=]
 	{
-		auto currentGroup = new threadGroup;
-		currentGroup->stars << stars.mid(groupIndex * groupSize, groupSize);
-		groups << currentGroup;
+		if (cancellation.isCancelled()) return;
+		distributeStarsInGroups(shellIndex, preparedShell(shellIndex), cancellation);
+		if (!cancellation.isCancelled()) QMetaObject::invokeMethod(this, [=]{ shellPrepared(shellIndex); }, Qt::QueuedConnection);
+	}, {_lastPrepareTask});
+	_tasks << _lastPrepareTask;
+}
+
+void Clustering::shellPrepared(const int shellIndex)
+{
+	_preparedShellCount = qMax(_preparedShellCount, shellIndex + 1);
+	placeNextShell();
+}
+
+void Clustering::placeNextShell()
+{
+	if (_cancellation.isCancelled() || _isPlacing || !_isNextClusterReady) return;
+	if (_currentShellIndex >= _engine->shellCount() || _currentShellIndex >= _preparedShellCount) return;
+
+	_isPlacing = true;
+	_shellPlacementTimer.start();
+	_starsPlacedInShell = 0;
+	_shellStarCount = _engine->storedStarCount(_currentShellIndex);
+	reserveGroups(preparedShell(_currentShellIndex).groups);
+
+	//The next shell is prepared while this one is placed
+	prepareShell(_currentShellIndex + 1);
+
+	if (_placementMode == placementMode::BULK)
+	{
+		placeAllStars();
+		return;
+	}
+
+	_placementTimer->start();
+	placeStars();
+}
+
+void Clustering::placeStars()
+{
+	OLBERS_TRACE_SCOPE("place stars", "placement");
+	placementShell& shell = preparedShell(_currentShellIndex);
+	QList<placementGroup>& groups = shell.groups;
+	_measuredTicks++;
+
+	bool shellDone = true;
+	for (int groupIndex = 0; groupIndex < groups.size(); groupIndex++)
+	{
+		placementGroup& group = groups[groupIndex];
+		if (group.placed == group.size()) continue;
+
+		const int sphereCount = group.count[starLod::SPHERE];
+		const starLod lod = group.placed < sphereCount ? starLod::SPHERE : starLod::IMPOSTOR;
+		const int star = group.begin[lod] + (lod == starLod::SPHERE ? group.placed : group.placed - sphereCount);
+		addStarInGroup(groupIndex, lod, shell.stars[star], shell.scales[star]);
+		group.placed++;
+		_starsPlaced++;
+		_starsPlacedInShell++;
+		shellDone &= group.placed == group.size();
 	}
-	const int overflowAmount = stars.size() % groupSize;
-	if (overflowAmount != 0)
+
 	{
-		auto overflow = new threadGroup;
-		overflow->stars << stars.mid(fullGroupCount * groupSize, overflowAmount);
-		groups << overflow;
+		OLBERS_TRACE_SCOPE("progress signals", "placement");
+		emit updateProgress(_starsPlaced, _totalStarCount);
+		emit updateProgress(_starsPlacedInShell, _shellStarCount, true);
+	}
+
+	if (!shellDone) return;
+
+	_placementTimer->stop();
+	finishShell();
+}
+
+void Clustering::placeAllStars()
+{
+	OLBERS_TRACE_SCOPE("place all stars", "placement");
+	placementShell& shell = preparedShell(_currentShellIndex);
+	QList<placementGroup>& groups = shell.groups;
+	for (int groupIndex = 0; groupIndex < groups.size(); groupIndex++)
+	{
+		placementGroup& group = groups[groupIndex];
+		for (int lod = 0; lod < STAR_LOD_COUNT; lod++)
+		{
+			if (group.count[lod] > 0) setStarsInGroup(groupIndex, starLod(lod), shell.stars.data() + group.begin[lod], shell.scales.data() + group.begin[lod], group.count[lod]);
+		}
+		group.placed = group.size();
+		_starsPlaced += group.placed;
+		_starsPlacedInShell += group.placed;
+	}
+
+	emit updateProgress(_starsPlaced, _totalStarCount);
+	emit updateProgress(_starsPlacedInShell, _shellStarCount, true);
+
+	finishShell();
+}
+
+void Clustering::finishShell()
+{
+	OLBERS_TRACE_SCOPE("finish shell", "placement");
+
+	//Render captures must see the whole shell
+	for (instancedStarGroup* group : qAsConst(_groups.last()))
+	{
+		for (InstancedStar* instancedStar : group->instancedStar) if (instancedStar) instancedStar->flush();
+	}
+
+	preparedShell(_currentShellIndex).clear();
+	_isPlacing = false;
+
+	addShellResult(_currentShellIndex);
+	const ShellResult result = _engine->getShellResult(_currentShellIndex);
+	const ShellTiming timing = result.timing;
+	const double placementTime = _shellPlacementTimer.nsecsElapsed() * 1e-6;
+	if (_dataTable && _engine->hasSightLines())
+	{
+		_dataTable->setColumnValue(_currentShellIndex, "Sight line covering fraction \n [1]", result.sightLineCoveringFraction);
+		_dataTable->setColumnValue(_currentShellIndex, "Mean first-hit distance \n [pc]", result.meanHitDistance);
+	}
+	if (_dataTable)
+	{
+		_dataTable->setTiming(_currentShellIndex, "Generation [ms]", timing.generation);
+		_dataTable->setTiming(_currentShellIndex, "Flux reduction [ms]", timing.reduction);
+		_dataTable->setTiming(_currentShellIndex, "Placement [ms]", placementTime);
+	}
+	_measuredStars += _shellStarCount;
+	_measuredGenerationSeconds += (timing.generation + timing.reduction) * 1e-3;
+	_measuredPlacementSeconds += placementTime * 1e-3;
+	_engine->writeCheckpoint(_currentShellIndex);
+	_currentShellIndex++;
+	_isNextClusterReady = false;
+	emit clusterDone();
+
+	//Was last shell to construct
+	if (_currentShellIndex == _engine->shellCount())
+	{
+		saveThroughput();
+		emit finished();
 	}
-	return groups;
 }
 
 Qt3DCore::QEntity* Clustering::createStar(const QVector3D& location)
@@ -68,31 +389,45 @@ Qt3DCore::QEntity* Clustering::createStar(const QVector3D& location)
 	return starEntity;
 }
 
-void Clustering::reserveGroups(const int count)
+void Clustering::reserveGroups(const QList<placementGroup>& groups)
 {
 	QList<instancedStarGroup*> newGroups;
-	for (int i = 0; i < count; i++)
+	for (const placementGroup& placement : groups)
 	{
 		auto group = new instancedStarGroup;
-		group->entity = new Qt3DCore::QEntity(_parentEntity);
-		group->instancedStar = new InstancedStar();
-		group->instancedStar->setRadius(_starSize);
-		group->instancedStar->setSlices(12);
-		group->instancedStar->setRings(12);
-		group->instancedStarMaterial = new InstancedStarMaterial();
-		group->geometryRenderer = new Qt3DRender::QGeometryRenderer();
-		group->geometryRenderer->setGeometry(group->instancedStar);
-		group->entity->addComponent(group->instancedStarMaterial);
-		group->entity->addComponent(group->geometryRenderer);
+		for (int lod = 0; lod < STAR_LOD_COUNT; lod++)
+		{
+			if (placement.count[lod] == 0) continue;
+
+			group->entity[lod] = new Qt3DCore::QEntity(_parentEntity);
+			group->instancedStar[lod] = new InstancedStar(starLod(lod));
+			group->instancedStar[lod]->setRadius(_starSize);
+			group->instancedStarMaterial[lod] = new InstancedStarMaterial(starLod(lod));
+			if (_engine->hasCompactStorage())
+			{
+				group->instancedStar[lod]->setCompact(placement.minDistance[lod], placement.maxDistance[lod]);
+				group->instancedStarMaterial[lod]->setCompactPositions(group->instancedStar[lod]->logDistanceMin(), group->instancedStar[lod]->logDistanceStep());
+			}
+			group->geometryRenderer[lod] = new Qt3DRender::QGeometryRenderer();
+			group->geometryRenderer[lod]->setGeometry(group->instancedStar[lod]);
+			group->geometryRenderer[lod]->setInstanceCount(0);
+			QObject::connect(group->instancedStar[lod], &InstancedStar::countChanged, group->geometryRenderer[lod], &Qt3DRender::QGeometryRenderer::setInstanceCount);
+			group->entity[lod]->addComponent(group->instancedStarMaterial[lod]);
+			group->entity[lod]->addComponent(group->geometryRenderer[lod]);
+		}
 		newGroups << group;
 	}
 	_groups << newGroups;
 }
 
-void Clustering::addStarInGroup(const int& index, const QVector3D& location)
+void Clustering::addStarInGroup(const int& index, const starLod lod, const QVector3D& location, const float scaleFactor)
+{
+	instancedStarGroup* activeGroup = _groups.last()[index];
+	activeGroup->instancedStar[lod]->addPoint(location, scaleFactor);
+}
+
+void Clustering::setStarsInGroup(const int& index, const starLod lod, const QVector3D* locations, const float* scaleFactors, const int count)
 {
 	instancedStarGroup* activeGroup = _groups.last()[index];
-	const float scaleFactor = 1.f / pow(location.length(), _starPowerFactor);
-	activeGroup->instancedStar->addPoint(location, scaleFactor);
-	activeGroup->geometryRenderer->setInstanceCount(activeGroup->instancedStar->getCount());
+	activeGroup->instancedStar[lod]->setPoints(locations, scaleFactors, count);
 }
@@ -2,6 +2,8 @@
 
 #include <QObject>
 #include <QThread>
+#include <QTimer>
+#include <QElapsedTimer>
 #include <QApplication>
 #include <QMatrix4x4>
 #include <Qt3DCore/QEntity>
@@ -15,56 +17,101 @@
 #include "LinearizedChart.h"
 #include "InstancedStar.h"
 #include "InstancedStarMaterial.h"
+#include "SimulationEngine.h"
+#include "TaskScheduler.h"
+#include "Estimator.h"
 
 class Clustering : public QObject
 {
 	Q_OBJECT
 public:
 	explicit Clustering(Qt3DCore::QEntity* parentEntity, QObject* parent = nullptr);
+	virtual ~Clustering();
 
-	virtual void start() = 0;
-	virtual void terminate() = 0;
+	virtual void start();
+	virtual void terminate();
+
+	//A checkpoint is written every time a shell/level is placed
+	void setCheckpointPath(const QString& path);
+	//Continues the run of a checkpoint on the next start(), the already placed shells/levels are only added to the data
+	bool resume(const QString& path);
 
 	void setCameraProjectionMatrix(const QMatrix4x4& projectionMatrix, const QMatrix4x4& viewMatrix, const QRect& rect);
 
 	void setStarProperties(const float size, const float powerFactor);
+	//Stars projected smaller than IMPOSTOR_PIXEL_RADIUS are drawn as impostors instead of spheres
+	void setImpostorsEnabled(const bool enabled){ _impostorsEnabled = enabled; };
+	void setPlacementMode(const placementMode mode){ _placementMode = mode; };
+	//Parameters of the run, those of the checkpoint once resumed
+	const SimulationParameters& parameters() const { return _engine->parameters(); };
+	//Keeps the stars as compact grid coordinates in the engine and compact instances on the GPU
+	void setCompactStorageEnabled(const bool enabled){ _engine->setCompactStorage(enabled); };
+	//Adds the covering fraction and mean first-hit distance of SIGHT_LINE_COUNT random sight lines to the data table
+	void setSightLinesEnabled(const bool enabled);
 
 	void setDataTable(DataTable* dataTable){ _dataTable = dataTable; };
 	void setDataChart(DataChart* dataChart){ _dataChart = dataChart; };
 	void setLinearizedChart(LinearizedChart* linearizedChart){ _linearizedChart = linearizedChart; };
-	void setNextClusterReady(){ _isNextClusterReady = true; };
+	void setNextClusterReady();
 
-public slots:
-	void reserveGroups(const int count);
-	void addStarInGroup(const int& index, const QVector3D& location);
+	//Throughput measured by previous runs of the method on this machine
+	static Throughput measuredThroughput(const clusteringMethod method);
+	//Peak memory of the engine and the placed stars
+	static double estimatedMemory(const RunEstimate& estimate, const bool compact = false);
 
 protected:
-	struct threadGroup
+	//Stars of a shell split into groups, every group places one star per tick. Bulk placement uses a single group
+	//The stars of a group are split by level of detail and placed in that order, each a span of the shell's arena
+	struct placementGroup
 	{
-		QThread* thread = nullptr;
-		QList<QVector3D> stars;
+		int begin[STAR_LOD_COUNT] = {};
+		int count[STAR_LOD_COUNT] = {};
+		//Range of the scaled distances, the bounds of compact instances
+		float minDistance[STAR_LOD_COUNT] = {};
+		float maxDistance[STAR_LOD_COUNT] = {};
+		int placed = 0;
+
+		int size() const { return count[starLod::SPHERE] + count[starLod::IMPOSTOR]; };
+	};
+
+	//Camera-relative positions and scales of a whole shell in one allocation, kept in the shell's order except for the level of detail split
+	//The arenas are reused by every other shell, so their capacity settles at the largest shell
+	struct placementShell
+	{
+		std::vector<QVector3D> stars;
+		std::vector<float> scales;
+		QList<placementGroup> groups;
+
+		void clear();
 	};
 
 	Qt3DCore::QEntity* _parentEntity = nullptr;
 
-	bool isPointVisible(const QVector3D& point);
-	QList<threadGroup*> distributeStarsInThreads(const QList<QVector3D>& stars);
+	std::unique_ptr<SimulationEngine> _engine;
+
+	Frustum getFrustum() const;
+	void distributeStarsInGroups(const int shellIndex, placementShell& outShell, const CancellationToken& cancellation) const;
 
 	Qt3DCore::QEntity* createStar(const QVector3D& location);
 
+	//Called on the GUI thread once every star of a shell/level is placed
+	virtual void addShellResult(const int shellIndex) = 0;
+
 	DataTable* _dataTable = nullptr;
 	DataChart* _dataChart = nullptr;
 	LinearizedChart* _linearizedChart = nullptr;
 
-	bool _isNextClusterReady = false;
+	int _totalStarCount = 0;
+	int _starsPlaced = 0;
 
 private:
+	//One renderer and instance buffer per level of detail, null for the levels without stars
 	struct instancedStarGroup
 	{
-		Qt3DCore::QEntity* entity = nullptr;
-		InstancedStar* instancedStar = nullptr;
-		InstancedStarMaterial* instancedStarMaterial = nullptr;
-		Qt3DRender::QGeometryRenderer* geometryRenderer = nullptr;
+		Qt3DCore::QEntity* entity[STAR_LOD_COUNT] = {};
+		InstancedStar* instancedStar[STAR_LOD_COUNT] = {};
+		InstancedStarMaterial* instancedStarMaterial[STAR_LOD_COUNT] = {};
+		Qt3DRender::QGeometryRenderer* geometryRenderer[STAR_LOD_COUNT] = {};
 	};
 
 	QMatrix4x4 _projectionMatrix;
@@ -73,13 +120,56 @@ private:
 
 	float _starSize = 0.05f;
 	float _starPowerFactor = 0.3f;
+	bool _impostorsEnabled = true;
+	placementMode _placementMode = placementMode::ANIMATED;
 
 	QList<QList<instancedStarGroup*>> _groups;
 
+	//Background generation and shell preparation, each shell depends on the previous one
+	CancellationToken _cancellation;
+	QList<TaskHandle> _tasks;
+	TaskHandle _lastPrepareTask;
+
+	//The shell being placed and the one prepared next
+	static constexpr int PREPARED_SHELL_SLOTS = 2;
+
+	//Written by the preparation tasks, read on the GUI thread after shellPrepared(). Shell i uses slot i % PREPARED_SHELL_SLOTS
+	placementShell _preparedShells[PREPARED_SHELL_SLOTS];
+	int _preparedShellCount = 0;
+
+	QTimer* _placementTimer = nullptr;
+	QElapsedTimer _shellPlacementTimer;
+	bool _isNextClusterReady = false;
+	bool _isPlacing = false;
+	int _currentShellIndex = 0;
+	int _starsPlacedInShell = 0;
+	int _shellStarCount = 0;
+
+	//Totals of this run, stored for the estimates of later runs
+	double _measuredStars = 0.;
+	double _measuredGenerationSeconds = 0.;
+	double _measuredPlacementSeconds = 0.;
+	int _measuredTicks = 0;
+
+	void prepareShell(const int shellIndex);
+	placementShell& preparedShell(const int shellIndex){ return _preparedShells[shellIndex % PREPARED_SHELL_SLOTS]; };
+	void reserveGroups(const QList<placementGroup>& groups);
+	void addStarInGroup(const int& index, const starLod lod, const QVector3D& location, const float scaleFactor);
+	void setStarsInGroup(const int& index, const starLod lod, const QVector3D* locations, const float* scaleFactors, const int count);
+	//Settings key of the generation throughput, placement doesn't depend on the method
+	static QString generationThroughputKey(const clusteringMethod method);
+	void saveThroughput() const;
+
+private slots:
+	void generated();
+	void shellPrepared(const int shellIndex);
+	void placeNextShell();
+	void placeStars();
+	void placeAllStars();
+	void finishShell();
+
 signals:
 	void clusterDone();
 	void finished();
 	void updateProgress(const int placed, const int total, bool cluster = false);
-	void requestAddStarInGroup(const int& index, const QVector3D& location);
-	void requestReserveGroups(const int count);
 };
@@ -78,10 +78,22 @@ DataChart::~DataChart()
 	delete _ui;
 }
 
-void DataChart::addDataPoint(const float x, const float y)
+void DataChart::addDataPoint(const float x, const float y, const float error)
 {
 	_series->append(x, y);
 
+	if (error > 0.f)
+	{
+		auto errorBar = new QLineSeries();
+		errorBar->setPen(QPen(QColor(Qt::blue), 1));
+		*errorBar << QPointF(x, y - error) << QPointF(x, y + error);
+		_chart->addSeries(errorBar);
+		errorBar->attachAxis(_horAxis);
+		errorBar->attachAxis(_vertAxis);
+		for (QLegendMarker* marker : _chart->legend()->markers(errorBar)) marker->setVisible(false);
+		_errorBarSeries << errorBar;
+	}
+
 	float xmax = -INFINITY;
 	float ymin = INFINITY;
 	float ymax = -INFINITY;
@@ -91,6 +103,11 @@ void DataChart::addDataPoint(const float x, const float y)
 		if (dataPoint.y() < ymin) ymin = dataPoint.y();
 		if (dataPoint.y() > ymax) ymax = dataPoint.y();
 	}
+	for (const QLineSeries* errorBar : qAsConst(_errorBarSeries))
+	{
+		ymin = qMin(ymin, float(errorBar->at(0).y()));
+		ymax = qMax(ymax, float(errorBar->at(1).y()));
+	}
 	_horAxis->setMax(xmax);
 	_vertAxis->setMin(ymin);
 	_vertAxis->setMax(ymax);
@@ -193,6 +210,13 @@ void DataChart::clear()
 		_logFitSeries = nullptr;
 	}
 
+	for (QLineSeries* errorBar : qAsConst(_errorBarSeries))
+	{
+		_chart->removeSeries(errorBar);
+		delete errorBar;
+	}
+	_errorBarSeries.clear();
+
 	_chart->legend()->hide();
 }
 
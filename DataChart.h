@@ -16,7 +16,8 @@ public:
 	DataChart(QWidget* parent = nullptr);
 	~DataChart();
 
-	void addDataPoint(const float x, const float y);
+	//An error above 0 draws a vertical error bar of y +- error
+	void addDataPoint(const float x, const float y, const float error = 0.f);
 	void clear();
 
 protected:
@@ -31,6 +32,7 @@ private:
 	QValueAxis* _vertAxis = nullptr;
 	QLabel* _chartLabel = nullptr;
 	QSplineSeries* _logFitSeries = nullptr;
+	QList<QLineSeries*> _errorBarSeries;
 
 private slots:
 	void logFit();
@@ -24,9 +24,15 @@ void DataTable::setCameraData(const float hfov, const float vfov, const float ar
 	_ui->angularAreaSqArcsecLineEdit->setText(QString::number(areaSqArcsec));
 }
 
+void DataTable::setSeed(const quint64 seed)
+{
+	_ui->seedLineEdit->setText(QString::number(seed));
+}
+
 void DataTable::setHeader(const clusteringMethod clusteringMethod)
 {
 	clear();
+	_ui->seedLineEdit->clear();
 	const QList<QString> header = HEADERS[clusteringMethod];
 	_ui->tableWidget->setColumnCount(header.size());
 	_ui->tableWidget->setHorizontalHeaderLabels(header);
@@ -37,6 +43,33 @@ void DataTable::clear()
 	_ui->tableWidget->clear();
 	_ui->tableWidget->setColumnCount(0);
 	_ui->tableWidget->setRowCount(0);
+	_extraColumns.clear();
+	_timingColumns.clear();
+	_timings.clear();
+}
+
+void DataTable::setTiming(const int row, const QString& column, const double milliseconds)
+{
+	if (!_timingColumns.contains(column)) _timingColumns << column;
+	_timings[row][column] = milliseconds;
+}
+
+void DataTable::setColumnValue(const int row, const QString& column, const double value)
+{
+	if (!_extraColumns.contains(column))
+	{
+		_extraColumns << column;
+		_ui->tableWidget->setColumnCount(_ui->tableWidget->columnCount() + 1);
+		_ui->tableWidget->setHorizontalHeaderItem(_ui->tableWidget->columnCount() - 1, new QTableWidgetItem(column));
+	}
+
+	const int columnIndex = _ui->tableWidget->columnCount() - _extraColumns.size() + _extraColumns.indexOf(column);
+	_ui->tableWidget->setItem(row, columnIndex, new QTableWidgetItem(QString::number(value, 'g', 14)));
+}
+
+int DataTable::rowCount() const
+{
+	return _ui->tableWidget->rowCount();
 }
 
 template<clusteringMethod E, typename... Args>
@@ -46,7 +79,7 @@ void DataTable::addRow([[maybe_unused]] Args... args)
 }
 
 template<>
-void DataTable::addRow<clusteringMethod::HALLEY>(const int shellIndex, const int starCount, const double totalApvmag, const double apvmagPerSqArcsec, const double linearSurfaceBrightness)
+void DataTable::addRow<clusteringMethod::HALLEY>(const int shellIndex, const int starCount, const double totalApvmag, const double apvmagPerSqArcsec, const double linearSurfaceBrightness, const double shellApvmag, const double shellApvmagPerSqArcsec)
 {
 	const QList<QString> text =
 	{
@@ -54,14 +87,16 @@ void DataTable::addRow<clusteringMethod::HALLEY>(const int shellIndex, const int
 		QString::number(starCount),
 		QString::number(totalApvmag, 'g', 14),
 		QString::number(apvmagPerSqArcsec, 'g', 14),
-		QString::number(linearSurfaceBrightness, 'g', 14)
+		QString::number(linearSurfaceBrightness, 'g', 14),
+		QString::number(shellApvmag, 'g', 14),
+		QString::number(shellApvmagPerSqArcsec, 'g', 14)
 	};
 
 	placeRow(text);
 }
 
 template<>
-void DataTable::addRow<clusteringMethod::FRACTAL>(const int levelIndex, const int starCount, const double totalApvmag, const double apvmagPerSqArcsec, const double linearSurfaceBrightness)
+void DataTable::addRow<clusteringMethod::FRACTAL>(const int levelIndex, const int starCount, const double totalApvmag, const double apvmagPerSqArcsec, const double linearSurfaceBrightness, const double levelApvmag, const double levelApvmagPerSqArcsec)
 {
 	const QList<QString> text =
 	{
@@ -69,7 +104,9 @@ void DataTable::addRow<clusteringMethod::FRACTAL>(const int levelIndex, const in
 		QString::number(starCount),
 		QString::number(totalApvmag, 'g', 14),
 		QString::number(apvmagPerSqArcsec, 'g', 14),
-		QString::number(linearSurfaceBrightness, 'g', 14)
+		QString::number(linearSurfaceBrightness, 'g', 14),
+		QString::number(levelApvmag, 'g', 14),
+		QString::number(levelApvmagPerSqArcsec, 'g', 14)
 	};
 
 	placeRow(text);
@@ -77,7 +114,7 @@ void DataTable::addRow<clusteringMethod::FRACTAL>(const int levelIndex, const in
 
 void DataTable::placeRow(const QList<QString>& text)
 {
-	if (Q_UNLIKELY(text.size() != _ui->tableWidget->columnCount())) throw std::logic_error("Row element count doesn't match cosumn count");
+	if (Q_UNLIKELY(text.size() != _ui->tableWidget->columnCount() - _extraColumns.size())) throw std::logic_error("Row element count doesn't match cosumn count");
 
 	_ui->tableWidget->insertRow(_ui->tableWidget->rowCount());
 	for (int i = 0; i < text.size(); i++)
@@ -96,6 +133,8 @@ void DataTable::onExport()
 	file.open(QIODevice::WriteOnly);
 	QTextStream fileStream(&file);
 
+	const bool exportTimings = _ui->exportTimingsCheckBox->isChecked();
+
 	//Header
 	for (int col = 0; col < _ui->tableWidget->columnCount(); col++)
 	{
@@ -103,7 +142,10 @@ void DataTable::onExport()
 	}
 	fileStream << "HFOV [deg]" << CSV_SEPARATOR
 			   << "VOFV [deg]" << CSV_SEPARATOR
-			   << QStringLiteral("Angular area [arcsec\u00B2]") << "\n";
+			   << QStringLiteral("Angular area [arcsec\u00B2]") << CSV_SEPARATOR
+			   << "Seed";
+	if (exportTimings) for (const QString& column : qAsConst(_timingColumns)) fileStream << CSV_SEPARATOR << column;
+	fileStream << "\n";
 
 	//Data
 	for (int row = 0; row < _ui->tableWidget->rowCount(); row++)
@@ -119,7 +161,17 @@ void DataTable::onExport()
 		}
 		if (Q_UNLIKELY(row == 0)) fileStream << _ui->hfovLineEdit->text() << CSV_SEPARATOR
 											 << _ui->vfovLineEdit->text() << CSV_SEPARATOR
-											 << _ui->angularAreaSqArcsecLineEdit->text();
+											 << _ui->angularAreaSqArcsecLineEdit->text() << CSV_SEPARATOR
+											 << _ui->seedLineEdit->text();
+		else if (exportTimings) fileStream << CSV_SEPARATOR << CSV_SEPARATOR << CSV_SEPARATOR;
+		if (exportTimings)
+		{
+			for (const QString& column : qAsConst(_timingColumns))
+			{
+				fileStream << CSV_SEPARATOR;
+				if (_timings[row].contains(column)) fileStream << _timings[row][column];
+			}
+		}
 		fileStream << "\n";
 	}
 
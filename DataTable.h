@@ -20,28 +20,39 @@ public:
 	~DataTable();
 
 	void setCameraData(const float hfov, const float vfov, const float areaSqDeg, const float areaSqArcsec);
+	void setSeed(const quint64 seed);
 
 	void setHeader(const clusteringMethod clusteringMethod);
 	void clear();
 
+	//Only exported, as extra columns in order of first use
+	void setTiming(const int row, const QString& column, const double milliseconds);
+	//Shown after the method's columns, added in order of first use
+	void setColumnValue(const int row, const QString& column, const double value);
+	int rowCount() const;
+
 	template<clusteringMethod E, typename... Args>
 	void addRow(Args... args);
 
 	template<>
-	void addRow<clusteringMethod::HALLEY>(const int shellIndex, const int starCount, const double totalApvmag, const double apvmagPerSqArcsec, const double linearSurfaceBrightness);
+	void addRow<clusteringMethod::HALLEY>(const int shellIndex, const int starCount, const double totalApvmag, const double apvmagPerSqArcsec, const double linearSurfaceBrightness, const double shellApvmag, const double shellApvmagPerSqArcsec);
 
 	template<>
-	void addRow<clusteringMethod::FRACTAL>(const int levelIndex, const int starCount, const double totalApvmag, const double apvmagPerSqArcsec, const double linearSurfaceBrightness);
+	void addRow<clusteringMethod::FRACTAL>(const int levelIndex, const int starCount, const double totalApvmag, const double apvmagPerSqArcsec, const double linearSurfaceBrightness, const double levelApvmag, const double levelApvmagPerSqArcsec);
 
 private:
 	void placeRow(const QList<QString>& text);
 
 	Ui::DataTable* _ui = nullptr;
 
+	QList<QString> _extraColumns;
+	QList<QString> _timingColumns;
+	QMap<int, QMap<QString, double>> _timings;
+
 	const QMap<clusteringMethod, QList<QString>> HEADERS =
 	{
-		{clusteringMethod::HALLEY, {"Shell index", "Visible star count \n n\u1D65 [1]", "Total apvmag \n m\u1D65 [mag]", "Sky brightness \n \u03BC [mag*arcsec\u207B\u00B2]", "e^(-\u03BC)"}},
-		{clusteringMethod::FRACTAL, {"Level index", "Visible star count \n n\u1D65 [1]", "Total apvmag \n m\u1D65 [mag]", "Sky brightness \n \u03BC [mag*arcsec\u207B\u00B2]", "e^(-\u03BC)"}}
+		{clusteringMethod::HALLEY, {"Shell index", "Visible star count \n n\u1D65 [1]", "Total apvmag \n m\u1D65 [mag]", "Sky brightness \n \u03BC [mag*arcsec\u207B\u00B2]", "e^(-\u03BC)", "Shell apvmag \n \u0394m\u1D65 [mag]", "Shell sky brightness \n \u0394\u03BC [mag*arcsec\u207B\u00B2]"}},
+		{clusteringMethod::FRACTAL, {"Level index", "Visible star count \n n\u1D65 [1]", "Total apvmag \n m\u1D65 [mag]", "Sky brightness \n \u03BC [mag*arcsec\u207B\u00B2]", "e^(-\u03BC)", "Level apvmag \n \u0394m\u1D65 [mag]", "Level sky brightness \n \u0394\u03BC [mag*arcsec\u207B\u00B2]"}}
 	};
 
 private slots:
@@ -12,15 +12,29 @@ constexpr float STELLAR_DENSITY = 100.f; //1/pc^3
 constexpr float STELLAR_RADIUS = 1.f;
 constexpr float ABSOLUTE_VISUAL_MAGNITUDE = 4.83f;
 
-constexpr int STARS_PER_THREAD = 500;
-constexpr int THREAD_SLEEP_TIME = 10; //ms
+constexpr int STARS_PER_GROUP = 500;
+constexpr int PLACEMENT_TICK_INTERVAL = 10; //ms, every placement group adds one star per tick
+constexpr int SIGHT_LINE_COUNT = 1 << 20; //Rays cast per shell/level when the GUI casts sight lines
 
 constexpr char CSV_SEPARATOR[] = "\t";
 
-constexpr float CULLING_FRACTION = float((CAMERA_HFOV + 2.f) * (CAMERA_VFOV + 2.f)) / (360.f * (360.f / CAMERA_ASPECT_RATIO));
-
 enum clusteringMethod
 {
 	HALLEY,
 	FRACTAL
 };
+
+enum placementMode
+{
+	ANIMATED, //Stars appear one by one
+	BULK //Every shell/level is uploaded at once
+};
+
+enum starLod
+{
+	SPHERE, //Full sphere mesh, near stars
+	IMPOSTOR //Camera-facing quad shaded as a disk, stars covering a few pixels
+};
+
+constexpr int STAR_LOD_COUNT = 2;
+constexpr float IMPOSTOR_PIXEL_RADIUS = 3.f; //px, stars projected smaller than this are drawn as impostors
@@ -1,7 +1,5 @@
 #pragma once
 
-#include <random>
-
 #include "Clustering.h"
 #include "Global.h"
 
@@ -9,30 +7,13 @@ class HalleyClustering : public Clustering
 {
 	Q_OBJECT
 public:
-	explicit HalleyClustering(Qt3DCore::QEntity* parentEntity, QObject* parent = nullptr, int shellCount = 1, float shellThickness = 50, float firstShellDistance = 1.29);
-
-	virtual void start() override;
-	virtual void terminate() override;
+	explicit HalleyClustering(Qt3DCore::QEntity* parentEntity, QObject* parent = nullptr, int shellCount = 1, float shellThickness = 50, float firstShellDistance = 1.29, quint64 seed = 0, float tolerance = 0.f);
 
-	static void calculateEstimate(int shellCount, float shellThickness, float firstShellDistance, QTime& outEstimatedTime, int& outEstimatedCount);
+protected:
+	virtual void addShellResult(const int shellIndex) override;
 
 private:
-
 	int _shellCount;
 	float _shellThickness;
 	float _firstShellDistance;
-
-	QList<QList<QVector3D>> _stars;
-	QRecursiveMutex _groupMutex;
-	int _currentShellIndex = 0;
-	QList<threadGroup*> _threadGroups;
-
-	bool _terminatePending = false;
-
-	int _totalStarCount = 0;
-	int _starsPlaced = 0;
-	int _starsPlacedInShell	= 0;
-
-private slots:
-	void constructShell();
 };
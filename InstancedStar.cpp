@@ -1,10 +1,20 @@
 #include "InstancedStar.h"
 
-InstancedStar::InstancedStar(Qt3DCore::QNode* parent) : Qt3DExtras::QSphereGeometry(parent)
+#include <algorithm>
+#include <iterator>
+#include <cmath>
+
+#include "Trace.h"
+
+InstancedStar::InstancedStar(const starLod lod, Qt3DCore::QNode* parent) : Qt3DRender::QGeometry(parent)
+  , _lod(lod)
   , _positionAttribute(new Qt3DRender::QAttribute(this))
   , _positionBuffer(new Qt3DRender::QBuffer(this))
   , _scaleAttribute(new Qt3DRender::QAttribute(this))
   , _scaleBuffer(new Qt3DRender::QBuffer(this))
+  , _boundsAttribute(new Qt3DRender::QAttribute(this))
+  , _boundsBuffer(new Qt3DRender::QBuffer(this))
+  , _uploadTimer(new QTimer(this))
 {
 	_positionAttribute->setAttributeType(Qt3DRender::QAttribute::AttributeType::VertexAttribute);
 	_positionAttribute->setBuffer(_positionBuffer);
@@ -21,54 +31,248 @@ InstancedStar::InstancedStar(Qt3DCore::QNode* parent) : Qt3DExtras::QSphereGeome
 	_scaleAttribute->setDivisor(1);
 	_scaleAttribute->setByteStride(sizeof(float));
 
-	addAttribute(_positionAttribute);
-	setBoundingVolumePositionAttribute(_positionAttribute);
+	//Not read by the shader, only used for the bounding volume
+	_boundsAttribute->setAttributeType(Qt3DRender::QAttribute::AttributeType::VertexAttribute);
+	_boundsAttribute->setBuffer(_boundsBuffer);
+	_boundsAttribute->setVertexBaseType(Qt3DRender::QAttribute::VertexBaseType::Float);
+	_boundsAttribute->setVertexSize(3);
+	_boundsAttribute->setName("bounds");
+	_boundsAttribute->setByteStride(3 * sizeof(float));
 
+	addAttribute(_positionAttribute);
 	addAttribute(_scaleAttribute);
+
+	addAttribute(_boundsAttribute);
+	setBoundingVolumePositionAttribute(_boundsAttribute);
+
+	_uploadTimer->setSingleShot(true);
+	_uploadTimer->setInterval(UPLOAD_INTERVAL);
+	QObject::connect(_uploadTimer, &QTimer::timeout, this, &InstancedStar::flush);
+
+	if (_lod == starLod::IMPOSTOR)
+	{
+		createQuad();
+		return;
+	}
+
+	//The sphere mesh attributes are shared with this geometry
+	_sphere = new Qt3DExtras::QSphereGeometry(this);
+	_sphere->setRings(SPHERE_DETAIL);
+	_sphere->setSlices(SPHERE_DETAIL);
+	_sphere->setRadius(_radius);
+	addAttribute(_sphere->positionAttribute());
+	addAttribute(_sphere->normalAttribute());
+	addAttribute(_sphere->indexAttribute());
 }
 
-void InstancedStar::setPoints(const QList<QVector3D>& points)
+void InstancedStar::createQuad()
 {
-	_points = points;
+	_quadVertexBuffer = new Qt3DRender::QBuffer(this);
+	_quadIndexBuffer = new Qt3DRender::QBuffer(this);
+	_quadVertexAttribute = new Qt3DRender::QAttribute(this);
+	_quadCornerAttribute = new Qt3DRender::QAttribute(this);
+	_quadIndexAttribute = new Qt3DRender::QAttribute(this);
+
+	_quadVertexAttribute->setAttributeType(Qt3DRender::QAttribute::AttributeType::VertexAttribute);
+	_quadVertexAttribute->setBuffer(_quadVertexBuffer);
+	_quadVertexAttribute->setVertexBaseType(Qt3DRender::QAttribute::VertexBaseType::Float);
+	_quadVertexAttribute->setVertexSize(3);
+	_quadVertexAttribute->setName(Qt3DRender::QAttribute::defaultPositionAttributeName());
+	_quadVertexAttribute->setByteStride(QUAD_VERTEX_SIZE * sizeof(float));
+	_quadVertexAttribute->setCount(4);
+
+	_quadCornerAttribute->setAttributeType(Qt3DRender::QAttribute::AttributeType::VertexAttribute);
+	_quadCornerAttribute->setBuffer(_quadVertexBuffer);
+	_quadCornerAttribute->setVertexBaseType(Qt3DRender::QAttribute::VertexBaseType::Float);
+	_quadCornerAttribute->setVertexSize(2);
+	_quadCornerAttribute->setName(Qt3DRender::QAttribute::defaultTextureCoordinateAttributeName());
+	_quadCornerAttribute->setByteOffset(3 * sizeof(float));
+	_quadCornerAttribute->setByteStride(QUAD_VERTEX_SIZE * sizeof(float));
+	_quadCornerAttribute->setCount(4);
+
+	QByteArray indexData(6 * sizeof(quint16), Qt::Uninitialized);
+	auto indexArray = reinterpret_cast<quint16*>(indexData.data());
+	const quint16 indices[] = {0, 1, 2, 0, 2, 3};
+	std::copy(std::begin(indices), std::end(indices), indexArray);
+	_quadIndexBuffer->setData(indexData);
+
+	_quadIndexAttribute->setAttributeType(Qt3DRender::QAttribute::AttributeType::IndexAttribute);
+	_quadIndexAttribute->setBuffer(_quadIndexBuffer);
+	_quadIndexAttribute->setVertexBaseType(Qt3DRender::QAttribute::VertexBaseType::UnsignedShort);
+	_quadIndexAttribute->setCount(6);
+
+	addAttribute(_quadVertexAttribute);
+	addAttribute(_quadCornerAttribute);
+	addAttribute(_quadIndexAttribute);
+	setRadius(_radius);
+}
 
-	_positionBufferData.resize(points.size() * sizeof(QVector3D));
-	auto vertexArray = reinterpret_cast<QVector3D*>(_positionBufferData.data());
-	_scaleBufferData.resize(points.size() * sizeof(float));
-	auto scaleArray = reinterpret_cast<float*>(_scaleBufferData.data());
+void InstancedStar::setRadius(const float radius)
+{
+	_radius = radius;
+	if (_sphere)
+	{
+		_sphere->setRadius(radius);
+		return;
+	}
 
-	for (int i = 0; i < points.size(); i++)
+	QByteArray vertexData(4 * QUAD_VERTEX_SIZE * sizeof(float), Qt::Uninitialized);
+	auto vertexArray = reinterpret_cast<float*>(vertexData.data());
+	const float corners[4][2] = {{-1.f, -1.f}, {1.f, -1.f}, {1.f, 1.f}, {-1.f, 1.f}};
+	for (int i = 0; i < 4; i++)
 	{
-		vertexArray[i] = points[i];
-		scaleArray[i] = 1.f;
+		float* vertex = vertexArray + i * QUAD_VERTEX_SIZE;
+		vertex[0] = corners[i][0] * radius;
+		vertex[1] = corners[i][1] * radius;
+		vertex[2] = 0.f;
+		vertex[3] = corners[i][0];
+		vertex[4] = corners[i][1];
 	}
+	_quadVertexBuffer->setData(vertexData);
+}
 
-	_positionBuffer->setData(_positionBufferData);
-	_positionAttribute->setCount(_points.size());
+void InstancedStar::setCompact(const float minDistance, const float maxDistance)
+{
+	_compact = true;
+
+	//Stars nearer than the near plane aren't drawn, their log distance is clamped to it. An empty range has no stars
+	_logDistanceMin = std::log(qMax(qMin(minDistance, maxDistance), CAMERA_NEAR_CLIP_PLANE));
+	_logDistanceStep = (std::log(qMax(maxDistance, CAMERA_NEAR_CLIP_PLANE)) - _logDistanceMin) / UINT16_MAX;
 
-	_scaleBuffer->setData(_scaleBufferData);
-	_scaleAttribute->setCount(_points.size());
+	_positionAttribute->setVertexBaseType(Qt3DRender::QAttribute::VertexBaseType::UnsignedShort);
+	_positionAttribute->setByteStride(sizeof(CompactInstance));
+	//The scale is part of the distance
+	removeAttribute(_scaleAttribute);
 }
 
-void InstancedStar::addPoint(const QVector3D& point, const float& scale)
+InstancedStar::CompactInstance InstancedStar::encode(const QVector3D& point, const float scale) const
+{
+	auto quantize = [](const float value) { return quint16(qBound(0.f, std::round(value), float(UINT16_MAX))); };
+
+	//Octahedral mapping, the far hemisphere is folded over the diagonals
+	const float length = qAbs(point.x()) + qAbs(point.y()) + qAbs(point.z());
+	float u = length > 0.f ? point.x() / length : 0.f;
+	float v = length > 0.f ? point.y() / length : 0.f;
+	if (point.z() < 0.f)
+	{
+		const float foldedU = (1.f - qAbs(v)) * (u >= 0.f ? 1.f : -1.f);
+		v = (1.f - qAbs(u)) * (v >= 0.f ? 1.f : -1.f);
+		u = foldedU;
+	}
+
+	CompactInstance instance;
+	instance.direction[0] = quantize((u * 0.5f + 0.5f) * UINT16_MAX);
+	instance.direction[1] = quantize((v * 0.5f + 0.5f) * UINT16_MAX);
+	const float logDistance = std::log(qMax(point.length() * scale, CAMERA_NEAR_CLIP_PLANE));
+	instance.logDistance = _logDistanceStep > 0.f ? quantize((logDistance - _logDistanceMin) / _logDistanceStep) : 0;
+	instance.padding = 0;
+	return instance;
+}
+
+void InstancedStar::writePoint(const int index, const QVector3D& point, const float scale)
+{
+	if (_compact)
+	{
+		reinterpret_cast<CompactInstance*>(_positionBufferData.data())[index] = encode(point, scale);
+	}
+	else
+	{
+		reinterpret_cast<QVector3D*>(_positionBufferData.data())[index] = point;
+		reinterpret_cast<float*>(_scaleBufferData.data())[index] = scale;
+	}
+	//The shaders draw the unscaled mesh around the scaled position
+	extendBounds(point * scale);
+}
+
+void InstancedStar::setPoints(const QVector3D* points, const float* scales, const int count)
 {
-	_positionBufferData.resize((_points.size() + 1) * sizeof(QVector3D));
-	auto vertexArray = reinterpret_cast<QVector3D*>(_positionBufferData.data());
-	_scaleBufferData.resize((_points.size() + 1) * sizeof(float));
-	auto scaleArray = reinterpret_cast<float*>(_scaleBufferData.data());
+	_count = 0;
+	_uploadedCount = 0;
+	_capacity = 0;
+	reserve(count);
+	_reallocated = true;
+
+	for (int i = 0; i < count; i++)
+	{
+		writePoint(i, points[i], scales[i]);
+		_count++;
+	}
 
-	vertexArray[_points.size()] = point;
-	scaleArray[_points.size()] = scale;
+	//Bulk data is sent right away
+	flush();
+}
 
-	_positionBuffer->setData(_positionBufferData);
-	_positionAttribute->setCount(_points.size() + 1);
+void InstancedStar::addPoint(const QVector3D& point, const float& scale)
+{
+	if (_count == _capacity) reserve(qMax(2 * _capacity, 64));
 
-	_scaleBuffer->setData(_scaleBufferData);
-	_scaleAttribute->setCount(_points.size() + 1);
+	writePoint(_count, point, scale);
+	_count++;
 
-	_points << point;
+	if (!_uploadTimer->isActive()) _uploadTimer->start();
 }
 
 int InstancedStar::getCount()
 {
-	return _points.size();
+	return _count;
+}
+
+void InstancedStar::reserve(const int capacity)
+{
+	if (capacity <= _capacity) return;
+
+	_capacity = capacity;
+	_positionBufferData.resize(_capacity * positionSize());
+	if (!_compact) _scaleBufferData.resize(_capacity * sizeof(float));
+	_reallocated = true;
+}
+
+void InstancedStar::extendBounds(const QVector3D& center)
+{
+	const QVector3D extent = QVector3D(1.f, 1.f, 1.f) * radius();
+	if (_count == 0)
+	{
+		_minExtent = center - extent;
+		_maxExtent = center + extent;
+		return;
+	}
+
+	_minExtent = QVector3D(qMin(_minExtent.x(), center.x() - extent.x()), qMin(_minExtent.y(), center.y() - extent.y()), qMin(_minExtent.z(), center.z() - extent.z()));
+	_maxExtent = QVector3D(qMax(_maxExtent.x(), center.x() + extent.x()), qMax(_maxExtent.y(), center.y() + extent.y()), qMax(_maxExtent.z(), center.z() + extent.z()));
+}
+
+void InstancedStar::flush()
+{
+	_uploadTimer->stop();
+	if (_count == _uploadedCount && !_reallocated) return;
+	OLBERS_TRACE_SCOPE("instance upload", "render");
+
+	if (_reallocated)
+	{
+		_positionBuffer->setData(_positionBufferData);
+		if (!_compact) _scaleBuffer->setData(_scaleBufferData);
+		_reallocated = false;
+	}
+	else
+	{
+		//Only the range appended since the last upload
+		const int positionOffset = _uploadedCount * positionSize();
+		const int scaleOffset = _uploadedCount * sizeof(float);
+		const int newCount = _count - _uploadedCount;
+		_positionBuffer->updateData(positionOffset, _positionBufferData.mid(positionOffset, newCount * positionSize()));
+		if (!_compact) _scaleBuffer->updateData(scaleOffset, _scaleBufferData.mid(scaleOffset, newCount * sizeof(float)));
+	}
+
+	_positionAttribute->setCount(_count);
+	_scaleAttribute->setCount(_count);
+
+	QByteArray boundsData(2 * sizeof(QVector3D), Qt::Uninitialized);
+	auto boundsArray = reinterpret_cast<QVector3D*>(boundsData.data());
+	boundsArray[0] = _minExtent;
+	boundsArray[1] = _maxExtent;
+	_boundsBuffer->setData(boundsData);
+	_boundsAttribute->setCount(2);
+
+	_uploadedCount = _count;
+	emit countChanged(_count);
 }
@@ -4,31 +4,111 @@
 #include <QVector3D>
 #include <QDataStream>
 #include <QMutex>
+#include <QTimer>
 
+#include <Qt3DRender/QGeometry>
 #include <Qt3DRender/QAttribute>
 #include <Qt3DRender/QBuffer>
 
 #include <Qt3DExtras/QSphereGeometry>
 
-class InstancedStar : public Qt3DExtras::QSphereGeometry
+#include "Global.h"
+
+class InstancedStar : public Qt3DRender::QGeometry
 {
 	Q_OBJECT
 public:
-	InstancedStar(Qt3DCore::QNode* parent = nullptr);
+	InstancedStar(const starLod lod = starLod::SPHERE, Qt3DCore::QNode* parent = nullptr);
+
+	//Points added within this interval are uploaded together, about one frame
+	static constexpr int UPLOAD_INTERVAL = 16; //ms
+	//Position and scale, kept in the staging buffers and in the Qt3D buffers
+	static constexpr int BYTES_PER_INSTANCE = 2 * (sizeof(QVector3D) + sizeof(float));
+	//Same for compact instances, direction and log distance padded to 8 bytes
+	static constexpr int COMPACT_BYTES_PER_INSTANCE = 2 * 4 * sizeof(quint16);
 
-	void setPoints(const QList<QVector3D>& points);
+	//Copies count points and scales into the staging buffers, the arrays aren't kept
+	void setPoints(const QVector3D* points, const float* scales, const int count);
 	void addPoint(const QVector3D& point, const float& scale = 1.f);
 
 	int getCount();
 
+	//Stores the instances as an octahedral direction and the log of their scaled distance within these bounds, 16 bits each.
+	//Must be called before any point is added, the material decodes them with logDistanceMin() and logDistanceStep()
+	void setCompact(const float minDistance, const float maxDistance);
+	bool isCompact() const { return _compact; };
+	float logDistanceMin() const { return _logDistanceMin; };
+	float logDistanceStep() const { return _logDistanceStep; };
+
+	void setRadius(const float radius);
+	float radius() const { return _radius; };
+	starLod lod() const { return _lod; };
+
+	//Uploads the pending points now instead of at the end of the interval
+	void flush();
+
+signals:
+	//Emitted after an upload, the instance count must not run ahead of the buffers
+	void countChanged(const int count);
+
 private:
+	//Rings and slices of the sphere level of detail
+	static constexpr int SPHERE_DETAIL = 12;
+	//Corner offset scaled by the radius followed by the unit corner
+	static constexpr int QUAD_VERTEX_SIZE = 5;
+
+	struct CompactInstance
+	{
+		quint16 direction[2];
+		quint16 logDistance;
+		quint16 padding;
+	};
+
+	starLod _lod;
+	float _radius = 1.f;
+
+	//Mesh of a single star, a sphere or a quad facing the camera
+	Qt3DExtras::QSphereGeometry* _sphere = nullptr;
+	Qt3DRender::QAttribute* _quadVertexAttribute = nullptr;
+	Qt3DRender::QAttribute* _quadCornerAttribute = nullptr;
+	Qt3DRender::QAttribute* _quadIndexAttribute = nullptr;
+	Qt3DRender::QBuffer* _quadVertexBuffer = nullptr;
+	Qt3DRender::QBuffer* _quadIndexBuffer = nullptr;
+
 	Qt3DRender::QAttribute* _positionAttribute = nullptr;
 	Qt3DRender::QBuffer* _positionBuffer = nullptr;
 
 	Qt3DRender::QAttribute* _scaleAttribute = nullptr;
 	Qt3DRender::QBuffer* _scaleBuffer = nullptr;
 
-	QList<QVector3D> _points;
+	//Two opposite corners of the instance bounds, so Qt3D doesn't rescan every instance position
+	Qt3DRender::QAttribute* _boundsAttribute = nullptr;
+	Qt3DRender::QBuffer* _boundsBuffer = nullptr;
+
+	QTimer* _uploadTimer = nullptr;
+
 	QByteArray _positionBufferData;
 	QByteArray _scaleBufferData;
+
+	bool _compact = false;
+	float _logDistanceMin = 0.f;
+	float _logDistanceStep = 0.f;
+
+	int _count = 0;
+	int _capacity = 0;
+	int _uploadedCount = 0;
+
+	//Buffers were reallocated since the last upload and must be sent whole
+	bool _reallocated = false;
+
+	QVector3D _minExtent;
+	QVector3D _maxExtent;
+
+	void createQuad();
+	int positionSize() const { return _compact ? sizeof(CompactInstance) : sizeof(QVector3D); };
+	CompactInstance encode(const QVector3D& point, const float scale) const;
+	void writePoint(const int index, const QVector3D& point, const float scale);
+	void reserve(const int capacity);
+	//Grows the bounds by a mesh around a drawn star center
+	void extendBounds(const QVector3D& center);
 };
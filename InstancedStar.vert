@@ -18,9 +18,11 @@ mat4 trf = mat4(1, 0, 0, 0,
 				0, 0, 1, 0,
 				0, 0, 0, 1);
 
+#pragma include starPosition.inc.vert
+
 void main()
 {
-	vec4 offsetPos = trf * vec4(vertexPosition, 1.0) + vec4((pos * scale), 0.0);
+	vec4 offsetPos = trf * vec4(vertexPosition, 1.0) + vec4(starPosition(pos, scale), 0.0);
 
 	worldNormal = normalize(mat3(trf) * vertexNormal);
 	worldPosition = vec3(offsetPos);
@@ -0,0 +1,35 @@
+#version 150 core
+
+// Same shading as InstancedStar.frag on the visible half of a sphere
+
+uniform vec3 ka;                            // Ambient reflectivity
+uniform vec3 kd;                            // Diffuse reflectivity
+uniform vec3 ks;                            // Specular reflectivity
+uniform float shininess;                    // Specular shininess factor
+
+uniform vec3 eyePosition;
+
+in vec3 starCenter;
+in vec2 corner;
+in vec3 cameraRight;
+in vec3 cameraUp;
+in vec3 cameraToEye;
+in float starRadius;
+
+out vec4 fragColor;
+
+#pragma include light.inc.frag
+
+void main()
+{
+	// Analytic disk, the corners of the quad are outside the star
+	float cornerLengthSquared = dot(corner, corner);
+	if (cornerLengthSquared > 1.0) discard;
+
+	vec3 worldNormal = normalize(cameraRight * corner.x + cameraUp * corner.y + cameraToEye * sqrt(1.0 - cornerLengthSquared));
+	vec3 worldPosition = starCenter + worldNormal * starRadius;
+
+	vec3 diffuseColor, specularColor;
+	adsModel(worldPosition, worldNormal, eyePosition, shininess, diffuseColor, specularColor);
+	fragColor = vec4( ka + kd * diffuseColor + ks * specularColor, 1.0 );
+}
@@ -0,0 +1,35 @@
+#version 150 core
+
+in vec3 vertexPosition;
+in vec2 vertexTexCoord;
+in vec3 pos;
+
+out vec3 starCenter;
+out vec2 corner;
+out vec3 cameraRight;
+out vec3 cameraUp;
+out vec3 cameraToEye;
+out float starRadius;
+
+uniform mat4 viewMatrix;
+uniform mat4 modelViewProjection;
+
+in float scale;
+
+#pragma include starPosition.inc.vert
+
+void main()
+{
+	starCenter = starPosition(pos, scale);
+	corner = vertexTexCoord;
+	// Unit corners are +-1
+	starRadius = vertexPosition.x * vertexTexCoord.x;
+
+	// Camera axes in world space, the quad always faces the camera. The view looks down -z, so z points back to the eye
+	cameraRight = vec3(viewMatrix[0][0], viewMatrix[1][0], viewMatrix[2][0]);
+	cameraUp = vec3(viewMatrix[0][1], viewMatrix[1][1], viewMatrix[2][1]);
+	cameraToEye = vec3(viewMatrix[0][2], viewMatrix[1][2], viewMatrix[2][2]);
+
+	vec3 offsetPos = starCenter + cameraRight * vertexPosition.x + cameraUp * vertexPosition.y;
+	gl_Position = modelViewProjection * vec4(offsetPos, 1.0);
+}
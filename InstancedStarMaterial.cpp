@@ -1,15 +1,21 @@
 #include "InstancedStarMaterial.h"
 
-InstancedStarMaterial::InstancedStarMaterial(Qt3DCore::QNode* parent) : Qt3DRender::QMaterial(parent)
+InstancedStarMaterial::InstancedStarMaterial(const starLod lod, Qt3DCore::QNode* parent) : Qt3DRender::QMaterial(parent)
   , _ambient(new Qt3DRender::QParameter("ka", QColor(212, 210, 165)))
   , _diffuse(new Qt3DRender::QParameter("kd", QColor(255, 253, 196)))
   , _specular(new Qt3DRender::QParameter("ks", QColor(1, 1, 1)))
   , _shininess(new Qt3DRender::QParameter("shininess", 150.f))
+  , _compactPositions(new Qt3DRender::QParameter("compactPositions", false))
+  , _logDistanceMin(new Qt3DRender::QParameter("logDistanceMin", 0.f))
+  , _logDistanceStep(new Qt3DRender::QParameter("logDistanceStep", 0.f))
 {
 	addParameter(_ambient);
 	addParameter(_diffuse);
 	addParameter(_specular);
 	addParameter(_shininess);
+	addParameter(_compactPositions);
+	addParameter(_logDistanceMin);
+	addParameter(_logDistanceStep);
 
 	auto effect = new Qt3DRender::QEffect();
 
@@ -25,11 +31,19 @@ InstancedStarMaterial::InstancedStarMaterial(Qt3DCore::QNode* parent) : Qt3DRend
 
 	auto renderPass = new Qt3DRender::QRenderPass();
 	auto shaderProgram = new Qt3DRender::QShaderProgram();
-	shaderProgram->setVertexShaderCode(Qt3DRender::QShaderProgram::loadSource(QUrl("qrc:/InstancedStar.vert")));
-	shaderProgram->setFragmentShaderCode(Qt3DRender::QShaderProgram::loadSource(QUrl("qrc:/InstancedStar.frag")));
+	const QString shaderName = lod == starLod::IMPOSTOR ? "InstancedStarImpostor" : "InstancedStar";
+	shaderProgram->setVertexShaderCode(Qt3DRender::QShaderProgram::loadSource(QUrl("qrc:/" + shaderName + ".vert")));
+	shaderProgram->setFragmentShaderCode(Qt3DRender::QShaderProgram::loadSource(QUrl("qrc:/" + shaderName + ".frag")));
 
 	renderPass->setShaderProgram(shaderProgram);
 	technique->addRenderPass(renderPass);
 	effect->addTechnique(technique);
 	setEffect(effect);
 }
+
+void InstancedStarMaterial::setCompactPositions(const float logDistanceMin, const float logDistanceStep)
+{
+	_compactPositions->setValue(true);
+	_logDistanceMin->setValue(logDistanceMin);
+	_logDistanceStep->setValue(logDistanceStep);
+}
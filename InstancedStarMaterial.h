@@ -13,16 +13,25 @@
 #include <Qt3DRender/QRenderPass>
 #include <Qt3DRender/QShaderProgram>
 
+#include "Global.h"
+
 class InstancedStarMaterial : public Qt3DRender::QMaterial
 {
 	Q_OBJECT
 public:
-	InstancedStarMaterial(Qt3DCore::QNode* parent = nullptr);
+	InstancedStarMaterial(const starLod lod = starLod::SPHERE, Qt3DCore::QNode* parent = nullptr);
+
+	//Decodes the instances of a compact InstancedStar, see InstancedStar::setCompact()
+	void setCompactPositions(const float logDistanceMin, const float logDistanceStep);
 
 private:
 	Qt3DRender::QParameter* _ambient = nullptr;
 	Qt3DRender::QParameter* _diffuse = nullptr;
 	Qt3DRender::QParameter* _specular = nullptr;
 	Qt3DRender::QParameter* _shininess = nullptr;
+
+	Qt3DRender::QParameter* _compactPositions = nullptr;
+	Qt3DRender::QParameter* _logDistanceMin = nullptr;
+	Qt3DRender::QParameter* _logDistanceStep = nullptr;
 };
 
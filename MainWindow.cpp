@@ -1,6 +1,9 @@
 #include "MainWindow.h"
 #include "ui_MainWindow.h"
 
+#include "Random.h"
+#include "Trace.h"
+
 MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent)
   , _ui(new Ui::MainWindow)
   , _progressStackPlaceholder(new QWidget())
@@ -9,6 +12,7 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent)
   , _clusterProgressStackPlaceholder(new QWidget())
   , _clusterProgressBar(new QProgressBar())
   , _clusterProgressLabel(new QLabel())
+  , _estimateTimer(new QTimer(this))
 {
 	_ui->setupUi(this);
 
@@ -69,24 +73,40 @@ MainWindow::MainWindow(QWidget* parent) : QMainWindow(parent)
 
 	_ui->dataTable->setCameraData(CAMERA_HFOV, CAMERA_VFOV, CAMERA_ANGULAR_AREA_SQ_DEG, CAMERA_ANGULAR_AREA_SQ_ARCSEC);
 
+	//Seeds are 64 bit, like those of the CLI and the checkpoints
+	_ui->seedLineEdit->setValidator(new QRegularExpressionValidator(QRegularExpression("\\d{1,20}"), this));
+
 	QObject::connect(_ui->clusteringComboBox, qOverload<int>(&QComboBox::currentIndexChanged), _ui->stackedWidget, &QStackedWidget::setCurrentIndex);
 	QObject::connect(_ui->runButton, &QPushButton::pressed, this, &MainWindow::onRunPressed);
 	QObject::connect(_ui->terminateButton, &QPushButton::pressed, this, &MainWindow::onTerminatePressed);
 	QObject::connect(_ui->clearButton, &QPushButton::pressed, this, &MainWindow::onClearPressed);
 
 	QObject::connect(_ui->renderSaveLocationButton, &QPushButton::clicked, this, &MainWindow::selectRenderSaveLocation);
-
-	QObject::connect(_ui->clusteringComboBox, qOverload<int>(&QComboBox::currentIndexChanged), this, &MainWindow::updateEstimate);
-	QObject::connect(_ui->shellCountSpinBox, qOverload<int>(&QSpinBox::valueChanged), this, &MainWindow::updateEstimate);
-	QObject::connect(_ui->shellThicknessSpinBox, qOverload<double>(&QDoubleSpinBox::valueChanged), this, &MainWindow::updateEstimate);
-	QObject::connect(_ui->firstShellDistanceSpinBox, qOverload<double>(&QDoubleSpinBox::valueChanged), this, &MainWindow::updateEstimate);
-	QObject::connect(_ui->levelCountSpinBox, qOverload<int>(&QSpinBox::valueChanged), this, &MainWindow::updateEstimate);
-	QObject::connect(_ui->countPerLevelSpinBox, qOverload<int>(&QSpinBox::valueChanged), this, &MainWindow::updateEstimate);
-	QObject::connect(_ui->spacingSpinBox, qOverload<double>(&QDoubleSpinBox::valueChanged), this, &MainWindow::updateEstimate);
+	QObject::connect(_ui->checkpointLocationButton, &QPushButton::clicked, this, &MainWindow::selectCheckpointLocation);
+	QObject::connect(_ui->resumeButton, &QPushButton::pressed, this, &MainWindow::onResumePressed);
+
+	//Every change restarts the timer, the estimate is only computed for the last one
+	_estimateTimer->setSingleShot(true);
+	_estimateTimer->setInterval(ESTIMATE_DELAY);
+	QObject::connect(_estimateTimer, &QTimer::timeout, this, &MainWindow::updateEstimate);
+	auto scheduleEstimate = [this]{ _estimateTimer->start(); };
+	QObject::connect(_ui->clusteringComboBox, qOverload<int>(&QComboBox::currentIndexChanged), this, scheduleEstimate);
+	QObject::connect(_ui->shellCountSpinBox, qOverload<int>(&QSpinBox::valueChanged), this, scheduleEstimate);
+	QObject::connect(_ui->shellThicknessSpinBox, qOverload<double>(&QDoubleSpinBox::valueChanged), this, scheduleEstimate);
+	QObject::connect(_ui->firstShellDistanceSpinBox, qOverload<double>(&QDoubleSpinBox::valueChanged), this, scheduleEstimate);
+	QObject::connect(_ui->toleranceSpinBox, qOverload<double>(&QDoubleSpinBox::valueChanged), this, scheduleEstimate);
+	QObject::connect(_ui->levelCountSpinBox, qOverload<int>(&QSpinBox::valueChanged), this, scheduleEstimate);
+	QObject::connect(_ui->countPerLevelSpinBox, qOverload<int>(&QSpinBox::valueChanged), this, scheduleEstimate);
+	QObject::connect(_ui->spacingSpinBox, qOverload<double>(&QDoubleSpinBox::valueChanged), this, scheduleEstimate);
+	QObject::connect(_ui->bulkPlacementCheckBox, &QCheckBox::toggled, this, scheduleEstimate);
+	QObject::connect(_ui->compactStorageCheckBox, &QCheckBox::toggled, this, scheduleEstimate);
+	scheduleEstimate();
 }
 
 MainWindow::~MainWindow()
 {
+	//The estimate task delivers its result to this window
+	if (_estimateTask) TaskScheduler::instance().wait(_estimateTask);
 	delete _ui;
 }
 
@@ -111,6 +131,7 @@ void MainWindow::updateUI(bool running)
 	}
 
 	_ui->runButton->setEnabled(!running);
+	_ui->resumeButton->setEnabled(!running);
 	_ui->terminateButton->setEnabled(running);
 	_ui->clearButton->setEnabled(!running);
 
@@ -133,26 +154,85 @@ void MainWindow::updateUI(bool running)
 	_ui->shellCountSpinBox->setEnabled(!running);
 	_ui->shellThicknessSpinBox->setEnabled(!running);
 	_ui->firstShellDistanceSpinBox->setEnabled(!running);
+	_ui->toleranceSpinBox->setEnabled(!running);
+	_ui->seedLineEdit->setEnabled(!running);
+	_ui->randomSeedCheckBox->setEnabled(!running);
 
 	_ui->levelCountSpinBox->setEnabled(!running);
 	_ui->countPerLevelSpinBox->setEnabled(!running);
 	_ui->spacingSpinBox->setEnabled(!running);
 	_ui->centralClusterCheckBox->setEnabled(!running);
 
+	_ui->bulkPlacementCheckBox->setEnabled(!running);
+	_ui->sightLinesCheckBox->setEnabled(!running);
+	_ui->compactStorageCheckBox->setEnabled(!running);
+
 	_ui->sizeSpinBox->setEnabled(!running);
 	_ui->distanceScalePowerSpinBox->setEnabled(!running);
+	_ui->impostorCheckBox->setEnabled(!running);
 
 	_ui->saveRenderCheckBox->setEnabled(!running);
 	_ui->renderSaveLocationButton->setEnabled(!running);
 	_ui->renderSaveLocationLineEdit->setEnabled(!running);
+
+	_ui->checkpointCheckBox->setEnabled(!running);
+	_ui->checkpointLocationButton->setEnabled(!running);
+	_ui->checkpointLocationLineEdit->setEnabled(!running);
+}
+
+placementMode MainWindow::getPlacementMode() const
+{
+	return _ui->bulkPlacementCheckBox->isChecked() ? placementMode::BULK : placementMode::ANIMATED;
 }
 
 void MainWindow::onRunPressed()
 {
-	updateUI(true);
+	startClustering(QString());
+}
+
+void MainWindow::onResumePressed()
+{
+	const QString checkpointPath = _ui->checkpointLocationLineEdit->text();
+	CheckpointState state;
+	std::string error;
+	if (!Checkpoint::read(checkpointPath.toStdString(), state, error))
+	{
+		_ui->statusbar->showMessage(QString::fromStdString(error), 30*1000);
+		return;
+	}
 
+	//Show the parameters of the resumed run
+	const SimulationParameters& parameters = state.parameters;
+	_ui->clusteringComboBox->setCurrentIndex(int(parameters.method));
+	_ui->shellCountSpinBox->setValue(parameters.shellCount);
+	_ui->shellThicknessSpinBox->setValue(parameters.shellThickness);
+	_ui->firstShellDistanceSpinBox->setValue(parameters.firstShellDistance);
+	_ui->toleranceSpinBox->setValue(parameters.tolerance);
+	_ui->randomSeedCheckBox->setChecked(false);
+	_ui->seedLineEdit->setText(QString::number(parameters.seed));
+	_ui->levelCountSpinBox->setValue(parameters.levelCount);
+	_ui->countPerLevelSpinBox->setValue(parameters.countPerLevel);
+	_ui->spacingSpinBox->setValue(parameters.spacing);
+	_ui->centralClusterCheckBox->setChecked(parameters.placeZeroStar);
+
+	startClustering(checkpointPath);
+}
+
+void MainWindow::startClustering(const QString& resumePath)
+{
 	const auto selectedClusteringMethod = static_cast<clusteringMethod>(_ui->clusteringComboBox->currentIndex());
 
+	if (_ui->randomSeedCheckBox->isChecked()) _ui->seedLineEdit->setText(QString::number(RandomStream::randomSeed()));
+	bool validSeed = false;
+	const quint64 seed = _ui->seedLineEdit->text().toULongLong(&validSeed);
+	if (!validSeed && selectedClusteringMethod == clusteringMethod::HALLEY)
+	{
+		_ui->statusbar->showMessage("The seed must be a number below 2^64", 30*1000);
+		return;
+	}
+
+	updateUI(true);
+
 	if (_activeClustering)
 	{
 		delete _activeClustering;
@@ -163,7 +243,7 @@ void MainWindow::onRunPressed()
 	{
 		case clusteringMethod::HALLEY:
 		{
-			auto halleyClustering = new HalleyClustering(_starRootEntity, this, _ui->shellCountSpinBox->value(), _ui->shellThicknessSpinBox->value(), _ui->firstShellDistanceSpinBox->value());
+			auto halleyClustering = new HalleyClustering(_starRootEntity, this, _ui->shellCountSpinBox->value(), _ui->shellThicknessSpinBox->value(), _ui->firstShellDistanceSpinBox->value(), seed, _ui->toleranceSpinBox->value());
 			_activeClustering = halleyClustering;
 			break;
 		}
@@ -181,10 +261,30 @@ void MainWindow::onRunPressed()
 
 	_activeClustering->setCameraProjectionMatrix(_viewport->camera()->projectionMatrix(), _viewport->camera()->viewMatrix(), _viewportContainer->rect());
 	_activeClustering->setStarProperties(_ui->sizeSpinBox->value(), _ui->distanceScalePowerSpinBox->value());
+	_activeClustering->setImpostorsEnabled(_ui->impostorCheckBox->isChecked());
+	_activeClustering->setPlacementMode(getPlacementMode());
+	_activeClustering->setCompactStorageEnabled(_ui->compactStorageCheckBox->isChecked());
+	//The stars of resumed shells/levels aren't available to trace, sampled shells only hold a few of theirs
+	const bool adaptive = selectedClusteringMethod == clusteringMethod::HALLEY && _ui->toleranceSpinBox->value() > 0.;
+	_activeClustering->setSightLinesEnabled(_ui->sightLinesCheckBox->isChecked() && resumePath.isEmpty() && !adaptive);
 	_activeClustering->setDataTable(_ui->dataTable);
 	_ui->dataTable->setHeader(selectedClusteringMethod);
 	_activeClustering->setDataChart(_ui->dataChart);
 	_activeClustering->setLinearizedChart(_ui->linearizedChart);
+
+	//A resumed run keeps writing to its checkpoint
+	const QString checkpointPath = _ui->checkpointLocationLineEdit->text();
+	if (!resumePath.isEmpty()) _activeClustering->setCheckpointPath(resumePath);
+	else if (_ui->checkpointCheckBox->isChecked() && !checkpointPath.isEmpty() && !adaptive) _activeClustering->setCheckpointPath(checkpointPath);
+
+	if (!resumePath.isEmpty() && !_activeClustering->resume(resumePath))
+	{
+		updateUI(false);
+		_ui->statusbar->showMessage("Unable to resume from " + resumePath, 30*1000);
+		return;
+	}
+	//A resumed run uses the seed of its checkpoint
+	if (selectedClusteringMethod == clusteringMethod::HALLEY) _ui->dataTable->setSeed(_activeClustering->parameters().seed);
 	_activeClustering->start();
 
 }
@@ -220,6 +320,9 @@ void MainWindow::onClearPressed()
 void MainWindow::onFinished()
 {
 	updateUI(false);
+
+	//The run measured new throughput
+	_estimateTimer->start();
 }
 
 void MainWindow::updateProgress(const int placed, const int total, bool cluster)
@@ -242,6 +345,13 @@ void MainWindow::selectRenderSaveLocation()
 	_ui->renderSaveLocationLineEdit->setText(saveLocation);
 }
 
+void MainWindow::selectCheckpointLocation()
+{
+	//Also used to pick an existing checkpoint to resume
+	const QString checkpointLocation = QFileDialog::getSaveFileName(nullptr, "Select checkpoint file", QDir::homePath(), "Checkpoints (*.olbckp)", nullptr, QFileDialog::DontConfirmOverwrite);
+	if (!checkpointLocation.isEmpty()) _ui->checkpointLocationLineEdit->setText(checkpointLocation);
+}
+
 void MainWindow::saveRender()
 {
 	if (!_ui->saveRenderCheckBox->isChecked() || !QDir(_ui->renderSaveLocationLineEdit->text()).exists())
@@ -251,12 +361,24 @@ void MainWindow::saveRender()
 	}
 
 	const QString timeSignature = QDateTime::currentDateTime().toString(Qt::ISODateWithMs);
+	const int row = _ui->dataTable->rowCount() - 1;
+	const int64_t captureStart = Trace::now();
 	_reply = _renderCapture->requestCapture();
 	QObject::connect(_reply, &Qt3DRender::QRenderCaptureReply::completed, [=]
 	{
+		const int64_t saveStart = Trace::now();
 		_reply->saveImage(_ui->renderSaveLocationLineEdit->text() + "/render_" + timeSignature + ".png");
 		_reply->deleteLater();
 		_reply = nullptr;
+
+		//Capture spans several frames, from the request to the saved PNG
+		const int64_t saveEnd = Trace::now();
+		if (Trace::isEnabled())
+		{
+			Trace::addSpan("render capture", "render", captureStart, saveStart);
+			Trace::addSpan("save render", "render", saveStart, saveEnd);
+		}
+		_ui->dataTable->setTiming(row, "Render capture [ms]", (saveEnd - captureStart) * 1e-6);
 	});
 
 	_activeClustering->setNextClusterReady();
@@ -264,18 +386,35 @@ void MainWindow::saveRender()
 
 void MainWindow::updateEstimate()
 {
-	const auto selectedClusteringMethod = static_cast<clusteringMethod>(_ui->clusteringComboBox->currentIndex());
-	QTime estimatedTime;
-	int estimatedCount;
-	switch (selectedClusteringMethod)
+	SimulationParameters parameters;
+	parameters.method = static_cast<clusteringMethod>(_ui->clusteringComboBox->currentIndex());
+	parameters.shellCount = _ui->shellCountSpinBox->value();
+	parameters.shellThickness = _ui->shellThicknessSpinBox->value();
+	parameters.firstShellDistance = _ui->firstShellDistanceSpinBox->value();
+	parameters.tolerance = _ui->toleranceSpinBox->value();
+	parameters.levelCount = _ui->levelCountSpinBox->value();
+	parameters.countPerLevel = _ui->countPerLevelSpinBox->value();
+	parameters.spacing = _ui->spacingSpinBox->value();
+	const placementMode mode = getPlacementMode();
+	const Throughput throughput = Clustering::measuredThroughput(parameters.method);
+	const int request = ++_estimateRequest;
+
+	_estimateTask = TaskScheduler::instance().submit([=]
 	{
-		case clusteringMethod::HALLEY:
-			HalleyClustering::calculateEstimate(_ui->shellCountSpinBox->value(), _ui->shellThicknessSpinBox->value(), _ui->firstShellDistanceSpinBox->value(), estimatedTime, estimatedCount);
-			break;
-		case clusteringMethod::FRACTAL:
-			FractalClustering::calculateEstimate(_ui->levelCountSpinBox->value(), _ui->countPerLevelSpinBox->value(), _ui->spacingSpinBox->value(), estimatedTime, estimatedCount);
-			break;
-	}
-	_ui->estimatedCountLineEdit->setText(QString::number(estimatedCount));
-	_ui->etaLineEdit->setText(estimatedTime.toString("hh:mm:ss"));
+		const RunEstimate estimate = Estimator::estimate(parameters, mode, QThread::idealThreadCount(), throughput);
+		QMetaObject::invokeMethod(this, [=]{ showEstimate(request, estimate); }, Qt::QueuedConnection);
+	}, {_estimateTask});
+}
+
+void MainWindow::showEstimate(const int request, const RunEstimate& estimate)
+{
+	if (request != _estimateRequest) return;
+
+	//Runs can take more than a day, QTime would wrap
+	const qint64 seconds = qRound64(estimate.seconds());
+	const QString eta = QString("%1:%2:%3").arg(seconds / 3600, 2, 10, QChar('0')).arg((seconds / 60) % 60, 2, 10, QChar('0')).arg(seconds % 60, 2, 10, QChar('0'));
+
+	_ui->estimatedCountLineEdit->setText(QString::number(qRound64(estimate.starCount)));
+	_ui->etaLineEdit->setText(eta);
+	_ui->estimatedMemoryLineEdit->setText(locale().formattedDataSize(qRound64(Clustering::estimatedMemory(estimate, _ui->compactStorageCheckBox->isChecked()))));
 }
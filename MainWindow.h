@@ -4,6 +4,7 @@
 #include <QProgressBar>
 #include <QStackedLayout>
 #include <QDateTime>
+#include <QRegularExpressionValidator>
 #include <Qt3DExtras/Qt3DWindow>
 #include <Qt3DExtras/QForwardRenderer>
 #include <Qt3DCore/QEntity>
@@ -33,6 +34,9 @@ protected:
 	virtual void resizeEvent(QResizeEvent* event) override;
 
 private:
+	//Delay after the last settings change before the estimate is updated
+	static constexpr int ESTIMATE_DELAY = 150; //ms
+
 	Ui::MainWindow* _ui = nullptr;
 
 	Qt3DExtras::Qt3DWindow* _viewport = nullptr;
@@ -57,10 +61,18 @@ private:
 	Qt3DRender::QRenderCapture* _renderCapture = nullptr;
 	Qt3DRender::QRenderCaptureReply* _reply = nullptr;
 
+	//Estimates run on the pool once the settings stop changing, older requests are dropped
+	QTimer* _estimateTimer = nullptr;
+	TaskHandle _estimateTask;
+	int _estimateRequest = 0;
+
 	void updateUI(bool running);
+	placementMode getPlacementMode() const;
+	void startClustering(const QString& resumePath);
 
 private slots:
 	void onRunPressed();
+	void onResumePressed();
 	void onTerminatePressed();
 	void onClearPressed();
 	void onFinished();
@@ -68,7 +80,9 @@ private slots:
 	void updateProgress(const int placed, const int total, bool cluster = false);
 
 	void selectRenderSaveLocation();
+	void selectCheckpointLocation();
 	void saveRender();
 
 	void updateEstimate();
+	void showEstimate(const int request, const RunEstimate& estimate);
 };
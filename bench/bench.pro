@@ -0,0 +1,23 @@
+QT = core gui 3dcore 3drender 3dextras
+
+CONFIG += c++17 console
+CONFIG -= app_bundle
+
+TARGET = OlbersParadoxSimulationBench
+
+include(../engine/engine.pri)
+
+# Instance buffer uploads are measured on the GUI's own class
+INCLUDEPATH += ..
+
+SOURCES += \
+	main.cpp \
+	../InstancedStar.cpp
+
+HEADERS += \
+	../InstancedStar.h
+
+# Default rules for deployment.
+qnx: target.path = /tmp/$${TARGET}/bin
+else: unix:!android: target.path = /opt/$${TARGET}/bin
+!isEmpty(target.path): INSTALLS += target
@@ -0,0 +1,403 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
+#include <QHash>
+#include <QThread>
+
+#include <algorithm>
+#include <memory>
+#include <cmath>
+#include <type_traits>
+
+#include "Global.h"
+#include "SimulationEngine.h"
+#include "HalleyGenerator.h"
+#include "FractalGenerator.h"
+#include "Parallel.h"
+#include "Random.h"
+#include "Simd.h"
+#include "InstancedStar.h"
+
+//Fixed, so every run measures the same catalog
+constexpr uint64_t BENCHMARK_SEED = 1;
+//Culling is measured on at least this many candidates
+constexpr size_t MIN_CULLING_CANDIDATES = 1 << 20;
+
+struct BenchmarkCase
+{
+	SimulationParameters parameters;
+	int threadCount = 0;
+
+	QString name() const
+	{
+		const SimulationParameters& p = parameters;
+		const QString threads = " threads=" + QString::number(threadCount);
+		if (p.method == clusteringMethod::HALLEY) return QString("halley shells=%1 thickness=%2 first=%3").arg(p.shellCount).arg(p.shellThickness).arg(p.firstShellDistance) + threads;
+		return QString("fractal levels=%1 count=%2 spacing=%3 central=%4").arg(p.levelCount).arg(p.countPerLevel).arg(p.spacing).arg(p.placeZeroStar) + threads;
+	}
+};
+
+struct StageResult
+{
+	QString name;
+	size_t stars = 0;
+	size_t bytes = 0;
+	double seconds = 0.; //Median of the repetitions
+
+	double starsPerSecond() const { return seconds > 0. ? stars / seconds : 0.; };
+	double bytesPerSecond() const { return seconds > 0. ? bytes / seconds : 0.; };
+};
+
+//Runs setup() untimed and stage() timed, repetitions times, and returns the median in seconds
+template<typename Setup, typename Stage>
+static double measure(const int repetitions, Setup setup, Stage stage)
+{
+	std::vector<double> seconds;
+	for (int repetition = 0; repetition < repetitions; repetition++)
+	{
+		setup();
+		QElapsedTimer timer;
+		timer.start();
+		stage();
+		seconds.push_back(timer.nsecsElapsed() * 1e-9);
+	}
+	std::sort(seconds.begin(), seconds.end());
+	return seconds[seconds.size() / 2];
+}
+
+static std::unique_ptr<StarGenerator> createGenerator(const SimulationParameters& p)
+{
+	if (p.method == clusteringMethod::HALLEY) return std::make_unique<HalleyGenerator>(p.shellCount, p.shellThickness, p.firstShellDistance, p.seed);
+	return std::make_unique<FractalGenerator>(p.levelCount, p.countPerLevel, p.spacing, p.placeZeroStar);
+}
+
+static QList<StageResult> runCase(const BenchmarkCase& benchmarkCase, const int repetitions)
+{
+	Parallel::setThreadCount(benchmarkCase.threadCount);
+	const Frustum frustum = SimulationEngine::defaultFrustum();
+	const std::unique_ptr<StarGenerator> generator = createGenerator(benchmarkCase.parameters);
+	const CancellationToken cancellation;
+	QList<StageResult> results;
+
+	//Generation, including the generators' own culling
+	StarCatalog catalog;
+	StageResult generation{"generation"};
+	generation.seconds = measure(repetitions, [&]{ catalog.clear(); }, [&]{ generator->generate(frustum, catalog, 0, cancellation); });
+	generation.stars = catalog.starCount();
+	generation.bytes = generation.stars * 3 * sizeof(float);
+	results << generation;
+
+	//Culling of uniform candidates in the cube around the catalog
+	float extent = 1.f;
+	for (int shellIndex = 0; shellIndex < catalog.shellCount(); shellIndex++)
+	{
+		const StarShell& shell = catalog.shell(shellIndex);
+		for (size_t i = 0; i < shell.size(); i++) extent = std::max(extent, float(shell.distance(i)));
+	}
+	StarShell candidates;
+	const size_t candidateCount = std::max(catalog.starCount(), MIN_CULLING_CANDIDATES);
+	candidates.reserve(candidateCount);
+	RandomStream random(BENCHMARK_SEED, 0, 0);
+	for (size_t i = 0; i < candidateCount; i++) candidates.append(random.uniform(-extent, extent), random.uniform(-extent, extent), random.uniform(-extent, extent));
+
+	StarShell visible;
+	StageResult culling{"culling"};
+	culling.seconds = measure(repetitions, [&]{ visible.clear(); }, [&]{ frustum.cull(candidates, visible); });
+	culling.stars = candidateCount;
+	culling.bytes = candidateCount * 3 * sizeof(float);
+	results << culling;
+
+	//Distance sorting of every shell/level
+	std::vector<StarShell> unsorted;
+	StageResult sorting{"sorting"};
+	sorting.seconds = measure(repetitions, [&]
+	{
+		unsorted.clear();
+		for (int shellIndex = 0; shellIndex < catalog.shellCount(); shellIndex++) unsorted.push_back(catalog.shell(shellIndex));
+	}, [&]
+	{
+		for (StarShell& shell : unsorted) shell.sortByDistance();
+	});
+	sorting.stars = catalog.starCount();
+	sorting.bytes = sorting.stars * 3 * sizeof(float);
+	results << sorting;
+
+	//Surface brightness reduction
+	FluxAccumulator flux;
+	StageResult brightness{"brightness"};
+	brightness.seconds = measure(repetitions, [&]{ flux.clear(); }, [&]
+	{
+		for (int shellIndex = 0; shellIndex < catalog.shellCount(); shellIndex++) flux.addShell(catalog.shell(shellIndex));
+	});
+	brightness.stars = catalog.starCount();
+	brightness.bytes = brightness.stars * 3 * sizeof(float);
+	results << brightness;
+
+	//Surface brightness reduction of the same shells in compact storage
+	std::vector<CompactShell> compactShells;
+	for (int shellIndex = 0; shellIndex < catalog.shellCount(); shellIndex++) compactShells.push_back(CompactShell::encode(catalog.shell(shellIndex)));
+	StageResult compactBrightness{"compact brightness"};
+	compactBrightness.seconds = measure(repetitions, [&]{ flux.clear(); }, [&]
+	{
+		for (const CompactShell& shell : compactShells) flux.addShell(shell, 1., 0.);
+	});
+	compactBrightness.stars = catalog.starCount();
+	compactBrightness.bytes = compactBrightness.stars * 3 * sizeof(uint16_t);
+	results << compactBrightness;
+
+	//Instance buffer uploads, star by star as in animated placement and whole shells as in bulk placement
+	//One arena for all shells, like the placement arenas of the GUI
+	std::vector<QVector3D> points(catalog.starCount());
+	std::vector<float> scales(catalog.starCount());
+	std::vector<size_t> shellBegin(catalog.shellCount() + 1, 0);
+	for (int shellIndex = 0; shellIndex < catalog.shellCount(); shellIndex++)
+	{
+		const StarShellView shell = catalog.shell(shellIndex);
+		shellBegin[shellIndex + 1] = shellBegin[shellIndex] + shell.size();
+		for (size_t i = 0; i < shell.size(); i++)
+		{
+			double x, y, z;
+			shell.position(i, x, y, z);
+			points[shellBegin[shellIndex] + i] = QVector3D(float(x), float(y), float(z));
+			scales[shellBegin[shellIndex] + i] = 1.f / pow(shell.distance(i), 0.3);
+		}
+	}
+
+	std::unique_ptr<InstancedStar> instancedStar;
+	StageResult upload{"upload"};
+	upload.seconds = measure(repetitions, [&]{ instancedStar = std::make_unique<InstancedStar>(); }, [&]
+	{
+		for (int shellIndex = 0; shellIndex < catalog.shellCount(); shellIndex++)
+		{
+			for (size_t i = shellBegin[shellIndex]; i < shellBegin[shellIndex + 1]; i++) instancedStar->addPoint(points[i], scales[i]);
+			instancedStar->flush();
+		}
+	});
+	upload.stars = catalog.starCount();
+	upload.bytes = upload.stars * (sizeof(QVector3D) + sizeof(float));
+	results << upload;
+
+	StageResult bulkUpload{"bulk upload"};
+	bulkUpload.seconds = measure(repetitions, [&]{ instancedStar = std::make_unique<InstancedStar>(); }, [&]
+	{
+		for (int shellIndex = 0; shellIndex < catalog.shellCount(); shellIndex++)
+		{
+			instancedStar->setPoints(points.data() + shellBegin[shellIndex], scales.data() + shellBegin[shellIndex], int(shellBegin[shellIndex + 1] - shellBegin[shellIndex]));
+			instancedStar->flush();
+		}
+	});
+	bulkUpload.stars = upload.stars;
+	bulkUpload.bytes = upload.bytes;
+	results << bulkUpload;
+
+	return results;
+}
+
+template<typename T>
+static bool parseList(const QString& value, QList<T>& outList)
+{
+	outList.clear();
+	for (const QString& item : value.split(',', Qt::SkipEmptyParts))
+	{
+		bool ok = false;
+		if constexpr (std::is_same_v<T, int>) outList << item.toInt(&ok);
+		else outList << item.toFloat(&ok);
+		if (!ok) return false;
+	}
+	return !outList.isEmpty();
+}
+
+//Flags every stage of the baseline that lost more than tolerance of its throughput, returns the number of regressions
+static int compareWithBaseline(QJsonArray& cases, const QJsonObject& baseline, const double tolerance)
+{
+	QHash<QString, double> baselineThroughput;
+	for (const QJsonValue& baselineCase : baseline["cases"].toArray())
+	{
+		for (const QJsonValue& stage : baselineCase["stages"].toArray())
+		{
+			baselineThroughput.insert(baselineCase["name"].toString() + "/" + stage["name"].toString(), stage["starsPerSecond"].toDouble());
+		}
+	}
+
+	int regressionCount = 0;
+	for (int caseIndex = 0; caseIndex < cases.size(); caseIndex++)
+	{
+		QJsonObject caseObject = cases[caseIndex].toObject();
+		QJsonArray stages = caseObject["stages"].toArray();
+		for (int stageIndex = 0; stageIndex < stages.size(); stageIndex++)
+		{
+			QJsonObject stage = stages[stageIndex].toObject();
+			const QString key = caseObject["name"].toString() + "/" + stage["name"].toString();
+			if (!baselineThroughput.contains(key) || baselineThroughput[key] <= 0.) continue;
+
+			const double ratio = stage["starsPerSecond"].toDouble() / baselineThroughput[key];
+			const bool regression = ratio < 1. - tolerance;
+			stage["baselineStarsPerSecond"] = baselineThroughput[key];
+			stage["ratio"] = ratio;
+			stage["regression"] = regression;
+			stages[stageIndex] = stage;
+
+			qInfo("%-70s %7.3fx%s", qPrintable(key), ratio, regression ? "  REGRESSION" : "");
+			if (regression) regressionCount++;
+		}
+		caseObject["stages"] = stages;
+		cases[caseIndex] = caseObject;
+	}
+	return regressionCount;
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication a(argc, argv);
+	QCoreApplication::setApplicationName("OlbersParadoxSimulationBench");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Olbers' paradox simulation benchmarks, writes the throughput of every pipeline stage as JSON. List options take comma separated values, every combination is a case");
+	parser.addHelpOption();
+
+	const QCommandLineOption methodOption("method", "Clustering methods: halley, fractal.", "methods", "halley,fractal");
+	const QCommandLineOption shellCountOption("shell-count", "Halley: numbers of shells.", "counts", "20");
+	const QCommandLineOption shellThicknessOption("shell-thickness", "Halley: shell thicknesses [pc].", "pc", "50");
+	const QCommandLineOption firstShellDistanceOption("first-shell-distance", "Halley: first shell distance [pc].", "pc", "1.29");
+	const QCommandLineOption levelCountOption("level-count", "Fractal: numbers of levels.", "counts", "4");
+	const QCommandLineOption countPerLevelOption("count-per-level", "Fractal: counts per level.", "counts", "3");
+	const QCommandLineOption spacingOption("spacing", "Fractal: spacings [pc].", "pc", "1");
+	const QCommandLineOption threadsOption("threads", "Thread counts, 0 = hardware concurrency.", "counts", "0");
+	const QCommandLineOption repetitionsOption("repetitions", "Repetitions of every stage, the median is reported.", "count", "5");
+	const QCommandLineOption outputOption({"o", "output"}, "JSON output file, stdout if omitted.", "file");
+	const QCommandLineOption baselineOption("baseline", "Compare with a previous JSON output and flag regressions.", "file");
+	const QCommandLineOption toleranceOption("tolerance", "Throughput loss flagged as a regression.", "fraction", "0.1");
+	parser.addOptions({methodOption, shellCountOption, shellThicknessOption, firstShellDistanceOption, levelCountOption, countPerLevelOption, spacingOption, threadsOption, repetitionsOption, outputOption, baselineOption, toleranceOption});
+
+	parser.process(a);
+
+	QList<int> shellCounts, levelCounts, countsPerLevel, threadCounts;
+	QList<float> shellThicknesses, firstShellDistances, spacings;
+	const bool validLists = parseList(parser.value(shellCountOption), shellCounts)
+		&& parseList(parser.value(shellThicknessOption), shellThicknesses)
+		&& parseList(parser.value(firstShellDistanceOption), firstShellDistances)
+		&& parseList(parser.value(levelCountOption), levelCounts)
+		&& parseList(parser.value(countPerLevelOption), countsPerLevel)
+		&& parseList(parser.value(spacingOption), spacings)
+		&& parseList(parser.value(threadsOption), threadCounts);
+	if (!validLists)
+	{
+		qCritical("Invalid parameter list");
+		return 1;
+	}
+	const int repetitions = qMax(parser.value(repetitionsOption).toInt(), 1);
+
+	//Every combination of the parameters of each method
+	QList<BenchmarkCase> cases;
+	for (const QString& method : parser.value(methodOption).toLower().split(',', Qt::SkipEmptyParts))
+	{
+		QList<SimulationParameters> methodParameters;
+		if (method == "halley")
+		{
+			for (int shellCount : shellCounts) for (float shellThickness : shellThicknesses) for (float firstShellDistance : firstShellDistances)
+			{
+				SimulationParameters parameters;
+				parameters.method = clusteringMethod::HALLEY;
+				parameters.shellCount = qMax(shellCount, 1);
+				parameters.shellThickness = shellThickness;
+				parameters.firstShellDistance = firstShellDistance;
+				methodParameters << parameters;
+			}
+		}
+		else if (method == "fractal")
+		{
+			for (int levelCount : levelCounts) for (int countPerLevel : countsPerLevel) for (float spacing : spacings)
+			{
+				SimulationParameters parameters;
+				parameters.method = clusteringMethod::FRACTAL;
+				parameters.levelCount = qMax(levelCount, 1);
+				parameters.countPerLevel = qMax(countPerLevel, 1);
+				parameters.spacing = spacing;
+				methodParameters << parameters;
+			}
+		}
+		else
+		{
+			qCritical("Unknown clustering method \"%s\"", qPrintable(method));
+			return 1;
+		}
+
+		for (SimulationParameters& parameters : methodParameters)
+		{
+			parameters.seed = BENCHMARK_SEED;
+			for (int threadCount : threadCounts) cases << BenchmarkCase{parameters, threadCount > 0 ? threadCount : QThread::idealThreadCount()};
+		}
+	}
+
+	QJsonArray caseArray;
+	for (const BenchmarkCase& benchmarkCase : qAsConst(cases))
+	{
+		QJsonArray stageArray;
+		for (const StageResult& stage : runCase(benchmarkCase, repetitions))
+		{
+			qInfo("%-70s %-12s %12.0f stars/s %12.0f B/s", qPrintable(benchmarkCase.name()), qPrintable(stage.name), stage.starsPerSecond(), stage.bytesPerSecond());
+			stageArray << QJsonObject{
+				{"name", stage.name},
+				{"stars", double(stage.stars)},
+				{"bytes", double(stage.bytes)},
+				{"seconds", stage.seconds},
+				{"starsPerSecond", stage.starsPerSecond()},
+				{"bytesPerSecond", stage.bytesPerSecond()}};
+		}
+
+		const SimulationParameters& p = benchmarkCase.parameters;
+		caseArray << QJsonObject{
+			{"name", benchmarkCase.name()},
+			{"method", p.method == clusteringMethod::HALLEY ? "halley" : "fractal"},
+			{"shellCount", p.shellCount},
+			{"shellThickness", p.shellThickness},
+			{"firstShellDistance", p.firstShellDistance},
+			{"levelCount", p.levelCount},
+			{"countPerLevel", p.countPerLevel},
+			{"spacing", p.spacing},
+			{"threads", benchmarkCase.threadCount},
+			{"stages", stageArray}};
+	}
+
+	int regressionCount = 0;
+	if (parser.isSet(baselineOption))
+	{
+		QFile baselineFile(parser.value(baselineOption));
+		if (!baselineFile.open(QIODevice::ReadOnly))
+		{
+			qCritical("Unable to open \"%s\"", qPrintable(baselineFile.fileName()));
+			return 1;
+		}
+		regressionCount = compareWithBaseline(caseArray, QJsonDocument::fromJson(baselineFile.readAll()).object(), parser.value(toleranceOption).toDouble());
+	}
+
+	const QJsonObject report{
+		{"version", 1},
+		{"simd", Simd::levelName(Simd::level())},
+		{"hardwareThreads", QThread::idealThreadCount()},
+		{"repetitions", repetitions},
+		{"seed", double(BENCHMARK_SEED)},
+		{"cases", caseArray},
+		{"regressions", regressionCount}};
+
+	QFile file;
+	if (parser.isSet(outputOption))
+	{
+		file.setFileName(parser.value(outputOption));
+		if (!file.open(QIODevice::WriteOnly))
+		{
+			qCritical("Unable to open \"%s\" for writing", qPrintable(file.fileName()));
+			return 1;
+		}
+	}
+	else file.open(stdout, QIODevice::WriteOnly);
+	file.write(QJsonDocument(report).toJson());
+	file.close();
+
+	//Non-zero so scripts can fail on regressions
+	return regressionCount > 0 ? 2 : 0;
+}
@@ -0,0 +1,256 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTextStream>
+
+#include "Global.h"
+#include "SimulationEngine.h"
+#include "HalleyGenerator.h"
+#include "Random.h"
+#include "Trace.h"
+
+static void writeTable(const SimulationEngine& engine, QTextStream& stream, const bool timings)
+{
+	const bool isHalley = engine.parameters().method == clusteringMethod::HALLEY;
+	const bool occlusion = engine.hasOcclusion();
+	const bool sightLines = engine.hasSightLines();
+	const bool adaptive = engine.parameters().isAdaptive();
+
+	//Header, same columns as the DataTable export
+	stream << (isHalley ? "Shell index" : "Level index") << CSV_SEPARATOR
+		   << "Visible star count [1]" << CSV_SEPARATOR
+		   << "Total apvmag [mag]" << CSV_SEPARATOR
+		   << "Sky brightness [mag*arcsec^-2]" << CSV_SEPARATOR
+		   << "e^(-mu)" << CSV_SEPARATOR
+		   << (isHalley ? "Shell apvmag [mag]" : "Level apvmag [mag]") << CSV_SEPARATOR
+		   << (isHalley ? "Shell sky brightness [mag*arcsec^-2]" : "Level sky brightness [mag*arcsec^-2]") << CSV_SEPARATOR
+		   << "HFOV [deg]" << CSV_SEPARATOR
+		   << "VOFV [deg]" << CSV_SEPARATOR
+		   << "Angular area [arcsec^2]" << CSV_SEPARATOR
+		   << "Seed";
+	if (adaptive) stream << CSV_SEPARATOR << "Sky brightness 95% CI [mag*arcsec^-2]";
+	if (occlusion) stream << CSV_SEPARATOR << "Covered sky fraction [1]" << CSV_SEPARATOR << "Occluded sky brightness [mag*arcsec^-2]";
+	if (sightLines) stream << CSV_SEPARATOR << "Sight line covering fraction [1]" << CSV_SEPARATOR << "Mean first-hit distance [pc]";
+	if (timings) stream << CSV_SEPARATOR << "Generation [ms]" << CSV_SEPARATOR << "Flux reduction [ms]";
+	stream << "\n";
+
+	for (int shellIndex = 0; shellIndex < engine.shellCount(); shellIndex++)
+	{
+		const ShellResult result = engine.getShellResult(shellIndex);
+		stream << result.shellIndex << CSV_SEPARATOR
+			   << qulonglong(result.starCount) << CSV_SEPARATOR
+			   << QString::number(result.brightness.totalApvmag, 'g', 14) << CSV_SEPARATOR
+			   << QString::number(result.brightness.surfaceBrightness, 'g', 14) << CSV_SEPARATOR
+			   << QString::number(result.brightness.linearSurfaceBrightness, 'g', 14) << CSV_SEPARATOR
+			   << QString::number(result.shellBrightness.totalApvmag, 'g', 14) << CSV_SEPARATOR
+			   << QString::number(result.shellBrightness.surfaceBrightness, 'g', 14);
+		if (Q_UNLIKELY(shellIndex == 0)) stream << CSV_SEPARATOR << CAMERA_HFOV
+												<< CSV_SEPARATOR << CAMERA_VFOV
+												<< CSV_SEPARATOR << CAMERA_ANGULAR_AREA_SQ_ARCSEC
+												<< CSV_SEPARATOR << qulonglong(engine.parameters().seed);
+		else if (timings || adaptive || occlusion || sightLines) stream << CSV_SEPARATOR << CSV_SEPARATOR << CSV_SEPARATOR << CSV_SEPARATOR;
+		if (adaptive) stream << CSV_SEPARATOR << QString::number(result.surfaceBrightnessError, 'g', 14);
+		if (occlusion) stream << CSV_SEPARATOR << QString::number(result.coveredFraction, 'g', 14) << CSV_SEPARATOR << QString::number(result.occludedBrightness.surfaceBrightness, 'g', 14);
+		if (sightLines) stream << CSV_SEPARATOR << QString::number(result.sightLineCoveringFraction, 'g', 14) << CSV_SEPARATOR << QString::number(result.meanHitDistance, 'g', 14);
+		if (timings) stream << CSV_SEPARATOR << result.timing.generation << CSV_SEPARATOR << result.timing.reduction;
+		stream << "\n";
+	}
+}
+
+int main(int argc, char *argv[])
+{
+	QCoreApplication a(argc, argv);
+	QCoreApplication::setApplicationName("OlbersParadoxSimulationCli");
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Headless Olbers' paradox simulation, writes the per-shell/per-level data table");
+	parser.addHelpOption();
+
+	const QCommandLineOption methodOption("method", "Clustering method: halley or fractal.", "method", "halley");
+	const QCommandLineOption shellCountOption("shell-count", "Halley: number of shells.", "count", "1");
+	const QCommandLineOption shellThicknessOption("shell-thickness", "Halley: shell thickness [pc].", "pc", "50");
+	const QCommandLineOption firstShellDistanceOption("first-shell-distance", "Halley: first shell distance [pc].", "pc", "1.29");
+	const QCommandLineOption toleranceOption("tolerance", "Halley: estimate large shells from stratified samples and stop once the sky brightness increment stays below this [mag/arcsec^2], with 95% confidence. 0 generates every star of every shell.", "mag", "0");
+	const QCommandLineOption sampleCountOption("sample-count", "Halley: stars drawn per sampled shell with --tolerance.", "count", "4096");
+	const QCommandLineOption levelCountOption("level-count", "Fractal: number of levels.", "count", "1");
+	const QCommandLineOption countPerLevelOption("count-per-level", "Fractal: count per level.", "count", "2");
+	const QCommandLineOption spacingOption("spacing", "Fractal: spacing [pc].", "pc", "1");
+	const QCommandLineOption centralClusterOption("central-cluster", "Fractal: place central cluster.");
+	const QCommandLineOption seedOption("seed", "Halley: random seed, same seed gives the same catalog. Random if omitted.", "seed");
+	const QCommandLineOption outputOption({"o", "output"}, "Output file, stdout if omitted.", "file");
+	const QCommandLineOption catalogOption("catalog", "Write the generated stars to a binary catalog file.", "file");
+	const QCommandLineOption outOfCoreOption("out-of-core", "Don't keep the generated stars in memory, requires --catalog.");
+	const QCommandLineOption compactOption("compact", "Keep the generated stars as 16 bit grid coordinates, about half the memory. Every star moves by less than 2^-13 of its distance.");
+	const QCommandLineOption inputCatalogOption("input-catalog", "Read the stars from a binary catalog file instead of generating them, generation options are ignored.", "file");
+	const QCommandLineOption plyOption("ply", "Export the stars as a binary PLY point cloud.", "file");
+	const QCommandLineOption skyMapOption("sky-map", "Write a surface brightness map [mag/arcsec^2] of the FOV with one plane per shell/level, as FITS or as raw floats if the file ends in .raw.", "file");
+	const QCommandLineOption skyMapSizeOption("sky-map-size", "Sky map size in pixels.", "WxH", "512x288");
+	const QCommandLineOption occlusionOption("occlusion", "Add the covered sky fraction and the sky brightness with near star disks hiding far ones, from an angular depth buffer of the FOV.");
+	const QCommandLineOption occlusionSizeOption("occlusion-size", "Occlusion depth buffer size in pixels.", "WxH", "1024x576");
+	const QCommandLineOption sightLinesOption("sight-lines", "Trace this many random sight lines through the FOV against the star spheres, adds the fraction that hits a star and the mean first-hit distance.", "count");
+	const QCommandLineOption checkpointOption("checkpoint", "Write a checkpoint every time a shell/level is completed.", "file");
+	const QCommandLineOption traceOption("trace", "Write a Chrome trace (Perfetto, chrome://tracing) of the run.", "file");
+	const QCommandLineOption timingsOption("timings", "Add per-shell/per-level timing columns to the table.");
+	const QCommandLineOption resumeOption("resume", "Continue the run of a checkpoint file, generation options are ignored. Keeps writing to it unless --checkpoint is set.", "file");
+	parser.addOptions({methodOption, shellCountOption, shellThicknessOption, firstShellDistanceOption, toleranceOption, sampleCountOption, levelCountOption, countPerLevelOption, spacingOption, centralClusterOption, seedOption, outputOption, catalogOption, outOfCoreOption, compactOption, inputCatalogOption, plyOption, skyMapOption, skyMapSizeOption, occlusionOption, occlusionSizeOption, sightLinesOption, checkpointOption, resumeOption, traceOption, timingsOption});
+
+	parser.process(a);
+
+	SimulationParameters parameters;
+	const QString method = parser.value(methodOption).toLower();
+	if (method == "halley") parameters.method = clusteringMethod::HALLEY;
+	else if (method == "fractal") parameters.method = clusteringMethod::FRACTAL;
+	else
+	{
+		qCritical("Unknown clustering method \"%s\"", qPrintable(method));
+		return 1;
+	}
+
+	parameters.shellCount = qMax(parser.value(shellCountOption).toInt(), 1);
+	parameters.shellThickness = parser.value(shellThicknessOption).toFloat();
+	parameters.firstShellDistance = parser.value(firstShellDistanceOption).toFloat();
+	parameters.tolerance = qMax(parser.value(toleranceOption).toFloat(), 0.f);
+	parameters.sampleCount = qMax(parser.value(sampleCountOption).toInt(), HalleyGenerator::STRATUM_COUNT * HalleyGenerator::MIN_STRATUM_SAMPLE_COUNT);
+	parameters.levelCount = qMax(parser.value(levelCountOption).toInt(), 1);
+	parameters.countPerLevel = qMax(parser.value(countPerLevelOption).toInt(), 1);
+	parameters.spacing = parser.value(spacingOption).toFloat();
+	parameters.placeZeroStar = parser.isSet(centralClusterOption);
+
+	parameters.seed = RandomStream::randomSeed();
+	if (parser.isSet(seedOption))
+	{
+		bool ok = false;
+		parameters.seed = parser.value(seedOption).toULongLong(&ok);
+		if (!ok)
+		{
+			qCritical("Invalid seed \"%s\"", qPrintable(parser.value(seedOption)));
+			return 1;
+		}
+	}
+
+	if (parser.isSet(outOfCoreOption) && !parser.isSet(catalogOption))
+	{
+		qCritical("--out-of-core requires --catalog");
+		return 1;
+	}
+	if (parser.isSet(compactOption) && parser.isSet(plyOption) && !parser.isSet(outOfCoreOption) && !parser.isSet(inputCatalogOption))
+	{
+		qCritical("--compact can't be combined with --ply, unless the stars are read back with --out-of-core");
+		return 1;
+	}
+	if (parser.isSet(resumeOption) && (parser.isSet(catalogOption) || parser.isSet(inputCatalogOption) || parser.isSet(skyMapOption) || parser.isSet(occlusionOption) || parser.isSet(sightLinesOption)))
+	{
+		qCritical("--resume can't be combined with --catalog, --input-catalog, --sky-map, --occlusion or --sight-lines");
+		return 1;
+	}
+
+	if (parameters.isAdaptive() && (parser.isSet(catalogOption) || parser.isSet(skyMapOption) || parser.isSet(occlusionOption) || parser.isSet(sightLinesOption) || parser.isSet(checkpointOption)))
+	{
+		qCritical("--tolerance can't be combined with --catalog, --sky-map, --occlusion, --sight-lines or --checkpoint");
+		return 1;
+	}
+
+	const QStringList skyMapSize = parser.value(skyMapSizeOption).toLower().split('x');
+	const int skyMapWidth = skyMapSize.size() == 2 ? skyMapSize[0].toInt() : 0;
+	const int skyMapHeight = skyMapSize.size() == 2 ? skyMapSize[1].toInt() : 0;
+	if (skyMapWidth <= 0 || skyMapHeight <= 0)
+	{
+		qCritical("Invalid sky map size \"%s\"", qPrintable(parser.value(skyMapSizeOption)));
+		return 1;
+	}
+
+	const QStringList occlusionSize = parser.value(occlusionSizeOption).toLower().split('x');
+	const int occlusionWidth = occlusionSize.size() == 2 ? occlusionSize[0].toInt() : 0;
+	const int occlusionHeight = occlusionSize.size() == 2 ? occlusionSize[1].toInt() : 0;
+	if (occlusionWidth <= 0 || occlusionHeight <= 0)
+	{
+		qCritical("Invalid occlusion size \"%s\"", qPrintable(parser.value(occlusionSizeOption)));
+		return 1;
+	}
+
+	bool sightLineCountValid = true;
+	const qulonglong sightLineCount = parser.isSet(sightLinesOption) ? parser.value(sightLinesOption).toULongLong(&sightLineCountValid) : 0;
+	if (!sightLineCountValid || (parser.isSet(sightLinesOption) && sightLineCount == 0))
+	{
+		qCritical("Invalid sight line count \"%s\"", qPrintable(parser.value(sightLinesOption)));
+		return 1;
+	}
+
+	if (parser.isSet(traceOption))
+	{
+		Trace::setThreadName("main");
+		Trace::setEnabled(true);
+	}
+
+	SimulationEngine engine(parameters);
+	if (parser.isSet(skyMapOption)) engine.setSkyMapOutput(parser.value(skyMapOption).toStdString(), skyMapWidth, skyMapHeight);
+	if (parser.isSet(occlusionOption)) engine.setOcclusionSize(occlusionWidth, occlusionHeight);
+	engine.setSightLineCount(sightLineCount);
+	engine.setCompactStorage(parser.isSet(compactOption));
+
+	QElapsedTimer timer;
+	timer.start();
+	if (parser.isSet(inputCatalogOption))
+	{
+		if (!engine.openCatalog(parser.value(inputCatalogOption).toStdString()))
+		{
+			qCritical("%s", engine.error().c_str());
+			return 1;
+		}
+		qInfo("Read %llu visible stars in %lld ms", qulonglong(engine.starCount()), timer.elapsed());
+	}
+	else
+	{
+		if (parser.isSet(checkpointOption)) engine.setCheckpointOutput(parser.value(checkpointOption).toStdString());
+		if (parser.isSet(resumeOption))
+		{
+			if (!engine.resumeCheckpoint(parser.value(resumeOption).toStdString()))
+			{
+				qCritical("%s", engine.error().c_str());
+				return 1;
+			}
+			qInfo("Resuming after %d completed shells/levels", engine.resumedShellCount());
+		}
+
+		qInfo("Seed %llu", qulonglong(engine.parameters().seed));
+		if (parser.isSet(catalogOption)) engine.setCatalogOutput(parser.value(catalogOption).toStdString(), parser.isSet(outOfCoreOption));
+		if (!engine.generate())
+		{
+			qCritical("%s", engine.error().c_str());
+			return 1;
+		}
+		qInfo("Generated %llu visible stars in %lld ms", qulonglong(engine.starCount()), timer.elapsed());
+	}
+
+	if (parser.isSet(plyOption) && !engine.exportPly(parser.value(plyOption).toStdString()))
+	{
+		qCritical("%s", engine.error().c_str());
+		return 1;
+	}
+
+	if (parser.isSet(traceOption) && !Trace::write(parser.value(traceOption).toStdString()))
+	{
+		qCritical("Unable to write \"%s\"", qPrintable(parser.value(traceOption)));
+		return 1;
+	}
+
+	QFile file;
+	if (parser.isSet(outputOption))
+	{
+		file.setFileName(parser.value(outputOption));
+		if (!file.open(QIODevice::WriteOnly))
+		{
+			qCritical("Unable to open \"%s\" for writing", qPrintable(file.fileName()));
+			return 1;
+		}
+	}
+	else file.open(stdout, QIODevice::WriteOnly);
+
+	QTextStream stream(&file);
+	writeTable(engine, stream, parser.isSet(timingsOption));
+	stream.flush();
+	file.close();
+
+	return 0;
+}
@@ -0,0 +1,341 @@
+#include "CatalogFile.h"
+
+#include <cstring>
+#include <algorithm>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "Trace.h"
+
+namespace
+{
+	size_t padding(const uint64_t position)
+	{
+		return (CatalogFormat::ALIGNMENT - position % CatalogFormat::ALIGNMENT) % CatalogFormat::ALIGNMENT;
+	}
+}
+
+bool CatalogFile::isLittleEndian()
+{
+	const uint16_t value = 1;
+	unsigned char firstByte;
+	std::memcpy(&firstByte, &value, 1);
+	return firstByte == 1;
+}
+
+size_t CatalogFile::paddedArraySize(const uint64_t starCount)
+{
+	const uint64_t size = starCount * sizeof(float);
+	return size + padding(size);
+}
+
+StoredParameters StoredParameters::fromParameters(const SimulationParameters& parameters, const Matrix4& viewProjectionMatrix)
+{
+	StoredParameters stored = {};
+	stored.seed = parameters.seed;
+	stored.method = int32_t(parameters.method);
+	stored.shellCount = parameters.shellCount;
+	stored.shellThickness = parameters.shellThickness;
+	stored.firstShellDistance = parameters.firstShellDistance;
+	stored.levelCount = parameters.levelCount;
+	stored.countPerLevel = parameters.countPerLevel;
+	stored.spacing = parameters.spacing;
+	stored.placeZeroStar = parameters.placeZeroStar;
+	std::copy(viewProjectionMatrix.begin(), viewProjectionMatrix.end(), stored.viewProjectionMatrix);
+	return stored;
+}
+
+SimulationParameters StoredParameters::toParameters() const
+{
+	SimulationParameters parameters;
+	parameters.method = clusteringMethod(method);
+	parameters.seed = seed;
+	parameters.shellCount = shellCount;
+	parameters.shellThickness = shellThickness;
+	parameters.firstShellDistance = firstShellDistance;
+	parameters.levelCount = levelCount;
+	parameters.countPerLevel = countPerLevel;
+	parameters.spacing = spacing;
+	parameters.placeZeroStar = placeZeroStar != 0;
+	return parameters;
+}
+
+Matrix4 StoredParameters::matrix() const
+{
+	Matrix4 matrix;
+	std::copy(std::begin(viewProjectionMatrix), std::end(viewProjectionMatrix), matrix.begin());
+	return matrix;
+}
+
+CatalogWriter::~CatalogWriter()
+{
+	if (isOpen()) close();
+}
+
+bool CatalogWriter::open(const std::string& path, const SimulationParameters& parameters, const Matrix4& viewProjectionMatrix)
+{
+	if (!CatalogFile::isLittleEndian())
+	{
+		_error = "Catalog files are only supported on little-endian hosts";
+		return false;
+	}
+
+	_file.open(path, std::ios::binary | std::ios::trunc);
+	if (!_file)
+	{
+		_error = "Unable to open \"" + path + "\" for writing";
+		return false;
+	}
+
+	_header = CatalogHeader();
+	std::memcpy(_header.magic, CatalogFormat::MAGIC, sizeof(_header.magic));
+	_header.version = CatalogFormat::VERSION;
+	_header.headerSize = sizeof(CatalogHeader);
+	_header.parameters = StoredParameters::fromParameters(parameters, viewProjectionMatrix);
+	_index.clear();
+
+	_file.write(reinterpret_cast<const char*>(&_header), sizeof(_header));
+	writePadding();
+	return bool(_file);
+}
+
+void CatalogWriter::writePadding()
+{
+	static const char zeros[CatalogFormat::ALIGNMENT] = {};
+	_file.write(zeros, padding(uint64_t(_file.tellp())));
+}
+
+void CatalogWriter::writeShell(const StarShellView& shell)
+{
+	OLBERS_TRACE_SCOPE("catalog write", "io");
+	if (!_file) return;
+
+	CatalogBlockHeader blockHeader;
+	blockHeader.magic = CatalogFormat::BLOCK_MAGIC;
+	blockHeader.shellIndex = uint32_t(_index.size());
+	blockHeader.starCount = shell.size();
+	_file.write(reinterpret_cast<const char*>(&blockHeader), sizeof(blockHeader));
+	writePadding();
+
+	_index.push_back({uint64_t(_file.tellp()), shell.size(), shell.anchorCount});
+	for (const float* coordinates : {shell.x, shell.y, shell.z})
+	{
+		_file.write(reinterpret_cast<const char*>(coordinates), shell.size() * sizeof(float));
+		writePadding();
+	}
+	_file.write(reinterpret_cast<const char*>(shell.anchors), shell.anchorCount * sizeof(StarAnchor));
+	writePadding();
+
+	_header.blockCount = _index.size();
+	_header.starCount += shell.size();
+}
+
+bool CatalogWriter::close()
+{
+	_header.indexOffset = uint64_t(_file.tellp());
+	_file.write(reinterpret_cast<const char*>(_index.data()), _index.size() * sizeof(CatalogIndexEntry));
+
+	//Complete the header now that the counts and the index location are known
+	_file.seekp(0);
+	_file.write(reinterpret_cast<const char*>(&_header), sizeof(_header));
+
+	const bool ok = bool(_file);
+	if (!ok) _error = "Unable to write the catalog";
+	_file.close();
+	return ok;
+}
+
+MappedCatalog::~MappedCatalog()
+{
+	close();
+}
+
+bool MappedCatalog::open(const std::string& path)
+{
+	close();
+
+	if (!CatalogFile::isLittleEndian())
+	{
+		_error = "Catalog files are only supported on little-endian hosts";
+		return false;
+	}
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		_error = "Unable to open \"" + path + "\"";
+		return false;
+	}
+
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx(file, &fileSize);
+	HANDLE mapping = fileSize.QuadPart > 0 ? CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+	const void* data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+	if (!data)
+	{
+		if (mapping) CloseHandle(mapping);
+		CloseHandle(file);
+		_error = "Unable to map \"" + path + "\"";
+		return false;
+	}
+
+	_fileHandle = file;
+	_mappingHandle = mapping;
+	_size = size_t(fileSize.QuadPart);
+#else
+	const int file = ::open(path.c_str(), O_RDONLY);
+	if (file < 0)
+	{
+		_error = "Unable to open \"" + path + "\"";
+		return false;
+	}
+
+	struct stat status;
+	const bool hasSize = fstat(file, &status) == 0 && status.st_size > 0;
+	void* data = hasSize ? mmap(nullptr, size_t(status.st_size), PROT_READ, MAP_PRIVATE, file, 0) : MAP_FAILED;
+	::close(file);
+	if (data == MAP_FAILED)
+	{
+		_error = "Unable to map \"" + path + "\"";
+		return false;
+	}
+
+	_size = size_t(status.st_size);
+#endif
+	_data = static_cast<const unsigned char*>(data);
+
+	//Validate everything the views will point at, a truncated or foreign file is rejected as a whole
+	const CatalogHeader& catalogHeader = header();
+	const bool validHeader = _size >= sizeof(CatalogHeader)
+		&& std::memcmp(catalogHeader.magic, CatalogFormat::MAGIC, sizeof(catalogHeader.magic)) == 0
+		&& (catalogHeader.version == CatalogFormat::VERSION || catalogHeader.version == CatalogFormat::VERSION_WITHOUT_ANCHORS)
+		&& catalogHeader.indexOffset >= sizeof(CatalogHeader)
+		&& catalogHeader.indexOffset <= _size;
+	const size_t entrySize = validHeader && catalogHeader.version == CatalogFormat::VERSION_WITHOUT_ANCHORS ? 2 * sizeof(uint64_t) : sizeof(CatalogIndexEntry);
+	if (!validHeader || catalogHeader.blockCount > (_size - catalogHeader.indexOffset) / entrySize)
+	{
+		close();
+		_error = "\"" + path + "\" isn't a complete star catalog";
+		return false;
+	}
+
+	_shells.reserve(catalogHeader.blockCount);
+	for (uint64_t block = 0; block < catalogHeader.blockCount; block++)
+	{
+		CatalogIndexEntry entry = {};
+		std::memcpy(&entry, _data + catalogHeader.indexOffset + block * entrySize, entrySize);
+		const uint64_t arraySize = CatalogFile::paddedArraySize(entry.starCount);
+		const bool validEntry = entry.starCount <= _size / sizeof(float)
+			&& entry.anchorCount <= _size / sizeof(StarAnchor)
+			&& entry.offset % CatalogFormat::ALIGNMENT == 0
+			&& entry.offset <= catalogHeader.indexOffset
+			&& 3 * arraySize + entry.anchorCount * sizeof(StarAnchor) <= catalogHeader.indexOffset - entry.offset;
+		const StarAnchor* anchors = validEntry ? reinterpret_cast<const StarAnchor*>(_data + entry.offset + 3 * arraySize) : nullptr;
+
+		//The first anchor starts the block, the others follow in order
+		bool validAnchors = validEntry && (entry.anchorCount == 0 || anchors[0].begin == 0);
+		for (uint64_t anchor = 1; validAnchors && anchor < entry.anchorCount; anchor++) validAnchors = anchors[anchor - 1].begin <= anchors[anchor].begin && anchors[anchor].begin <= entry.starCount;
+		if (!validAnchors)
+		{
+			close();
+			_error = "\"" + path + "\" has a corrupt index";
+			return false;
+		}
+
+		const float* x = reinterpret_cast<const float*>(_data + entry.offset);
+		const float* y = reinterpret_cast<const float*>(_data + entry.offset + arraySize);
+		const float* z = reinterpret_cast<const float*>(_data + entry.offset + 2 * arraySize);
+		_shells.emplace_back(x, y, z, size_t(entry.starCount), entry.anchorCount > 0 ? anchors : nullptr, size_t(entry.anchorCount));
+	}
+
+	return true;
+}
+
+void MappedCatalog::close()
+{
+	_shells.clear();
+	if (!_data) return;
+
+#ifdef _WIN32
+	UnmapViewOfFile(_data);
+	CloseHandle(_mappingHandle);
+	CloseHandle(_fileHandle);
+	_mappingHandle = nullptr;
+	_fileHandle = nullptr;
+#else
+	munmap(const_cast<unsigned char*>(_data), _size);
+#endif
+	_data = nullptr;
+	_size = 0;
+}
+
+bool CatalogFile::exportPly(const std::string& path, const std::vector<StarShellView>& shells, std::string& outError)
+{
+	if (!CatalogFile::isLittleEndian())
+	{
+		outError = "PLY export is only supported on little-endian hosts";
+		return false;
+	}
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	if (!file)
+	{
+		outError = "Unable to open \"" + path + "\" for writing";
+		return false;
+	}
+
+	size_t vertexCount = 0;
+	for (const StarShellView& shell : shells) vertexCount += shell.size();
+
+	file << "ply\n"
+		 << "format binary_little_endian 1.0\n"
+		 << "comment Olbers' paradox simulation star catalog\n"
+		 << "element vertex " << vertexCount << "\n"
+		 << "property float x\n"
+		 << "property float y\n"
+		 << "property float z\n"
+		 << "property int shell\n"
+		 << "end_header\n";
+
+	//PLY vertices are interleaved, convert in batches so memory use doesn't depend on the catalog size
+	struct PlyVertex
+	{
+		float x, y, z;
+		int32_t shell;
+	};
+	static_assert(sizeof(PlyVertex) == 16, "PLY vertices must be tightly packed");
+
+	constexpr size_t BATCH_SIZE = 1 << 16;
+	std::vector<PlyVertex> batch;
+	batch.reserve(BATCH_SIZE);
+	for (size_t shellIndex = 0; shellIndex < shells.size(); shellIndex++)
+	{
+		const StarShellView& shell = shells[shellIndex];
+		for (size_t begin = 0; begin < shell.size(); begin += BATCH_SIZE)
+		{
+			const size_t end = std::min(begin + BATCH_SIZE, shell.size());
+			batch.clear();
+			shell.forEachSegment(begin, end, [&](const StarAnchor& anchor, const size_t first, const size_t last)
+			{
+				for (size_t i = first; i < last; i++) batch.push_back({float(anchor.x + shell.x[i]), float(anchor.y + shell.y[i]), float(anchor.z + shell.z[i]), int32_t(shellIndex)});
+			});
+			file.write(reinterpret_cast<const char*>(batch.data()), batch.size() * sizeof(PlyVertex));
+		}
+	}
+
+	if (!file)
+	{
+		outError = "Unable to write \"" + path + "\"";
+		return false;
+	}
+	return true;
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+#include <cstddef>
+
+#include "StarCatalog.h"
+#include "Frustum.h"
+#include "SimulationParameters.h"
+
+//Binary star catalog, little-endian:
+//  CatalogHeader
+//  one block per shell/level: CatalogBlockHeader, then x[], y[] and z[] as float arrays and the StarAnchor array, each padded to CATALOG_ALIGNMENT
+//  index: CatalogIndexEntry per block, located by CatalogHeader::indexOffset. Version 1 files have no anchors and no anchorCount
+//The header is written first with zero counts and completed when the writer is closed, a file without an index is incomplete
+namespace CatalogFormat
+{
+	constexpr char MAGIC[8] = {'O', 'L', 'B', 'E', 'R', 'S', 'C', 'T'};
+	constexpr uint32_t VERSION = 2;
+	//Still read, observer-relative positions only
+	constexpr uint32_t VERSION_WITHOUT_ANCHORS = 1;
+	constexpr uint32_t BLOCK_MAGIC = 0x4B4C4853; //"SHLK"
+	constexpr size_t ALIGNMENT = 64;
+}
+
+//Simulation parameters and view frustum as stored in catalog and checkpoint files
+struct StoredParameters
+{
+	uint64_t seed;
+	int32_t method;
+	int32_t shellCount;
+	float shellThickness;
+	float firstShellDistance;
+	int32_t levelCount;
+	int32_t countPerLevel;
+	float spacing;
+	int32_t placeZeroStar;
+
+	//Column-major, the frustum the stars were culled with
+	float viewProjectionMatrix[16];
+
+	static StoredParameters fromParameters(const SimulationParameters& parameters, const Matrix4& viewProjectionMatrix);
+	SimulationParameters toParameters() const;
+	Matrix4 matrix() const;
+};
+
+struct CatalogHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t headerSize;
+
+	StoredParameters parameters;
+
+	uint64_t blockCount;
+	uint64_t starCount;
+	uint64_t indexOffset;
+};
+
+struct CatalogBlockHeader
+{
+	uint32_t magic;
+	uint32_t shellIndex;
+	uint64_t starCount;
+};
+
+struct CatalogIndexEntry
+{
+	uint64_t offset; //Of the x array, y, z and the anchors follow at paddedArraySize() intervals
+	uint64_t starCount;
+	uint64_t anchorCount;
+};
+
+static_assert(sizeof(StarAnchor) == 32, "Anchors are stored as they are in memory");
+
+//Streams shells to a catalog file as they are generated
+class CatalogWriter
+{
+public:
+	~CatalogWriter();
+
+	bool open(const std::string& path, const SimulationParameters& parameters, const Matrix4& viewProjectionMatrix);
+	void writeShell(const StarShellView& shell);
+	bool close();
+
+	bool isOpen() const { return _file.is_open(); };
+	const std::string& error() const { return _error; };
+
+private:
+	void writePadding();
+
+	std::ofstream _file;
+	std::string _error;
+	CatalogHeader _header;
+	std::vector<CatalogIndexEntry> _index;
+};
+
+//Read-only, memory-mapped catalog. Shell views point straight into the mapping
+class MappedCatalog
+{
+public:
+	MappedCatalog() = default;
+	~MappedCatalog();
+	MappedCatalog(const MappedCatalog&) = delete;
+	MappedCatalog& operator=(const MappedCatalog&) = delete;
+
+	bool open(const std::string& path);
+	void close();
+
+	bool isOpen() const { return _data != nullptr; };
+	const std::string& error() const { return _error; };
+
+	const CatalogHeader& header() const { return *reinterpret_cast<const CatalogHeader*>(_data); };
+	SimulationParameters parameters() const { return header().parameters.toParameters(); };
+	Matrix4 viewProjectionMatrix() const { return header().parameters.matrix(); };
+
+	int shellCount() const { return int(_shells.size()); };
+	size_t starCount() const { return header().starCount; };
+	StarShellView shell(const int index) const { return _shells[index]; };
+
+private:
+	const unsigned char* _data = nullptr;
+	size_t _size = 0;
+	std::vector<StarShellView> _shells;
+	std::string _error;
+
+#ifdef _WIN32
+	void* _fileHandle = nullptr;
+	void* _mappingHandle = nullptr;
+#endif
+};
+
+namespace CatalogFile
+{
+	//Files are written in host byte order, only little-endian hosts are supported
+	bool isLittleEndian();
+
+	//Bytes of one coordinate array including its padding
+	size_t paddedArraySize(const uint64_t starCount);
+
+	//Binary little-endian PLY with float x, y, z and an int shell property per vertex
+	bool exportPly(const std::string& path, const std::vector<StarShellView>& shells, std::string& outError);
+}
@@ -0,0 +1,123 @@
+#include "Checkpoint.h"
+
+#include <cstring>
+#include <cstddef>
+#include <filesystem>
+
+#include "Trace.h"
+
+namespace
+{
+	//FNV-1a over the record without its checksum
+	uint64_t recordChecksum(const CheckpointRecord& record)
+	{
+		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&record);
+		uint64_t hash = 0xcbf29ce484222325;
+		for (size_t i = 0; i < offsetof(CheckpointRecord, checksum); i++)
+		{
+			hash ^= bytes[i];
+			hash *= 0x100000001b3;
+		}
+		return hash;
+	}
+}
+
+bool CheckpointWriter::open(const std::string& path, const SimulationParameters& parameters, const Matrix4& viewProjectionMatrix)
+{
+	if (!CatalogFile::isLittleEndian())
+	{
+		_error = "Checkpoints are only supported on little-endian hosts";
+		return false;
+	}
+
+	_error.clear();
+	_file.close();
+	_file.open(path, std::ios::binary | std::ios::trunc);
+	if (!_file)
+	{
+		_error = "Unable to open \"" + path + "\" for writing";
+		return false;
+	}
+
+	CheckpointHeader header = {};
+	std::memcpy(header.magic, CheckpointFormat::MAGIC, sizeof(header.magic));
+	header.version = CheckpointFormat::VERSION;
+	header.headerSize = sizeof(CheckpointHeader);
+	header.parameters = StoredParameters::fromParameters(parameters, viewProjectionMatrix);
+	_file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	_file.flush();
+	return bool(_file);
+}
+
+bool CheckpointWriter::append(const std::string& path, const CheckpointState& state)
+{
+	_error.clear();
+	_file.close();
+
+	std::error_code errorCode;
+	std::filesystem::resize_file(path, state.validSize, errorCode);
+	if (!errorCode) _file.open(path, std::ios::binary | std::ios::app);
+	if (errorCode || !_file)
+	{
+		_error = "Unable to open \"" + path + "\" for writing";
+		return false;
+	}
+	return true;
+}
+
+bool CheckpointWriter::writeShell(const int shellIndex, const FluxAccumulator& flux)
+{
+	CheckpointRecord record = {};
+	record.shellIndex = shellIndex;
+	record.shellStarCount = flux.shellStarCount(shellIndex);
+	record.shellFlux = flux.shellFlux(shellIndex);
+	record.cumulativeFluxSum = flux.cumulativeFluxSum(shellIndex).sum();
+	record.cumulativeFluxCompensation = flux.cumulativeFluxSum(shellIndex).compensation();
+	return writeRecord(record);
+}
+
+bool CheckpointWriter::writeRecord(CheckpointRecord record)
+{
+	OLBERS_TRACE_SCOPE("checkpoint write", "io");
+	record.magic = CheckpointFormat::RECORD_MAGIC;
+	record.checksum = recordChecksum(record);
+	_file.write(reinterpret_cast<const char*>(&record), sizeof(record));
+	_file.flush();
+
+	if (!_file) _error = "Unable to write the checkpoint";
+	return bool(_file);
+}
+
+bool Checkpoint::read(const std::string& path, CheckpointState& outState, std::string& outError)
+{
+	std::ifstream file(path, std::ios::binary);
+	if (!file)
+	{
+		outError = "Unable to open \"" + path + "\"";
+		return false;
+	}
+
+	CheckpointHeader header;
+	file.read(reinterpret_cast<char*>(&header), sizeof(header));
+	if (!file || std::memcmp(header.magic, CheckpointFormat::MAGIC, sizeof(header.magic)) != 0 || header.version != CheckpointFormat::VERSION || header.headerSize != sizeof(CheckpointHeader))
+	{
+		outError = "\"" + path + "\" isn't a checkpoint";
+		return false;
+	}
+
+	outState.parameters = header.parameters.toParameters();
+	outState.viewProjectionMatrix = header.parameters.matrix();
+	outState.records.clear();
+	outState.validSize = sizeof(header);
+
+	CheckpointRecord record;
+	while (file.read(reinterpret_cast<char*>(&record), sizeof(record)))
+	{
+		const bool valid = record.magic == CheckpointFormat::RECORD_MAGIC && record.checksum == recordChecksum(record) && record.shellIndex == int(outState.records.size());
+		if (!valid) break;
+
+		outState.records.push_back(record);
+		outState.validSize += sizeof(record);
+	}
+	return true;
+}
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <cstdint>
+
+#include "CatalogFile.h"
+#include "FluxAccumulator.h"
+
+//Checkpoint file, little-endian:
+//  CheckpointHeader
+//  one CheckpointRecord appended per completed shell/level, in order
+//Random streams are counter based and keyed by the seed and shell index, so the shell index is the whole generator state.
+//A record torn by a crash fails its checksum, it and everything after it are ignored
+namespace CheckpointFormat
+{
+	constexpr char MAGIC[8] = {'O', 'L', 'B', 'E', 'R', 'S', 'C', 'P'};
+	constexpr uint32_t VERSION = 1;
+	constexpr uint32_t RECORD_MAGIC = 0x44524352; //"RCRD"
+}
+
+struct CheckpointHeader
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t headerSize;
+
+	StoredParameters parameters;
+};
+
+struct CheckpointRecord
+{
+	uint32_t magic;
+	int32_t shellIndex;
+	uint64_t shellStarCount;
+	double shellFlux;
+	double cumulativeFluxSum;
+	double cumulativeFluxCompensation;
+	uint64_t checksum;
+};
+
+struct CheckpointState
+{
+	SimulationParameters parameters;
+	Matrix4 viewProjectionMatrix;
+	std::vector<CheckpointRecord> records;
+	uint64_t validSize = 0; //Bytes up to the end of the last valid record
+};
+
+class CheckpointWriter
+{
+public:
+	//Starts a new checkpoint file
+	bool open(const std::string& path, const SimulationParameters& parameters, const Matrix4& viewProjectionMatrix);
+	//Continues the checkpoint a state was read from, dropping anything after its last valid record
+	bool append(const std::string& path, const CheckpointState& state);
+	void close(){ _file.close(); };
+
+	//Records a completed shell and flushes, a checkpoint is one small write
+	bool writeShell(const int shellIndex, const FluxAccumulator& flux);
+	bool writeRecord(CheckpointRecord record);
+
+	bool isOpen() const { return _file.is_open(); };
+	const std::string& error() const { return _error; };
+
+private:
+	std::ofstream _file;
+	std::string _error;
+};
+
+namespace Checkpoint
+{
+	bool read(const std::string& path, CheckpointState& outState, std::string& outError);
+}
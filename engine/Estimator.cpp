@@ -0,0 +1,142 @@
+#include "Estimator.h"
+
+#include <cmath>
+#include <algorithm>
+#include <climits>
+
+#include "HalleyGenerator.h"
+#include "FractalGenerator.h"
+
+double Estimator::frustumSolidAngleFraction()
+{
+	//Solid angle of a rectangular pyramid with half angles a and b is 4 * asin(sin(a) * sin(b))
+	const double verticalHalfAngle = CAMERA_VFOV * M_PI / 360.;
+	const double horizontalHalfAngle = std::atan(CAMERA_ASPECT_RATIO * std::tan(verticalHalfAngle));
+	return std::asin(std::sin(horizontalHalfAngle) * std::sin(verticalHalfAngle)) / M_PI;
+}
+
+double Estimator::sphereVisibleFraction(const double centerDistance, const double radius)
+{
+	if (radius <= 0.) return 1.;
+
+	//The frustum is replaced by the circular cone of the same solid angle
+	const double cosConeAngle = 1. - 2. * frustumSolidAngleFraction();
+
+	//Integrate over spheres around the camera, each one crosses the star sphere in a cap around the view axis
+	auto visibleArea = [&](const double r)
+	{
+		if (r <= 0.) return 0.;
+		double cosCapAngle = -1.;
+		if (r > radius - centerDistance)
+		{
+			cosCapAngle = (r * r + centerDistance * centerDistance - radius * radius) / (2. * r * centerDistance);
+			if (cosCapAngle >= 1.) return 0.;
+		}
+		return 2. * M_PI * r * r * (1. - std::max(cosCapAngle, cosConeAngle));
+	};
+
+	constexpr int STEPS = 512;
+	const double begin = std::max(0., centerDistance - radius);
+	const double end = centerDistance + radius;
+	const double step = (end - begin) / STEPS;
+	double volume = visibleArea(begin) + visibleArea(end);
+	for (int i = 1; i < STEPS; i++) volume += (i % 2 == 1 ? 4. : 2.) * visibleArea(begin + i * step);
+	volume *= step / 3.;
+
+	return std::min(volume / ((4. / 3.) * M_PI * radius * radius * radius), 1.);
+}
+
+int Estimator::adaptiveShellCount(const double tolerance)
+{
+	//Every shell adds about the same flux, so shell n raises the sky brightness by 2.5 * log10(1 + 1 / n)
+	const double settledShell = 1. / (std::pow(10., tolerance / 2.5) - 1.);
+	return int(std::min(std::ceil(settledShell) + 1. + HalleyGenerator::SETTLED_SHELL_COUNT, double(INT_MAX)));
+}
+
+long long Estimator::fractalLevelFactor(const int level, const std::vector<float>& volumeRadius, const float spacing)
+{
+	//Same lattice as calculateLevelOffsets, counted one row at a time
+	const float increment = (2 * volumeRadius[level - 1]) + spacing;
+	const float maxExtent = volumeRadius[level] - volumeRadius[level - 1];
+	const double maxLength = FractalGenerator::calculateMaxOffset(level, volumeRadius);
+	const int steps = int(std::lround(maxExtent / increment));
+	const double maxLengthSquared = (maxLength * maxLength) / (double(increment) * increment);
+
+	long long count = 0;
+	for (int i = -steps; i <= steps; i++)
+	{
+		for (int j = -steps; j <= steps; j++)
+		{
+			const double remaining = maxLengthSquared - double(i * i + j * j);
+			if (remaining <= 0.) continue;
+
+			//Largest k with k^2 < remaining
+			long long k = std::max(0LL, (long long)std::ceil(std::sqrt(remaining)) - 1);
+			while (double((k + 1) * (k + 1)) < remaining) k++;
+			while (k > 0 && double(k * k) >= remaining) k--;
+			count += 2 * std::min(k, (long long)steps) + 1;
+		}
+	}
+	return count;
+}
+
+RunEstimate Estimator::estimate(const SimulationParameters& parameters, const placementMode mode, const int threadCount, const Throughput& throughput)
+{
+	RunEstimate estimate;
+
+	switch (parameters.method)
+	{
+		case clusteringMethod::HALLEY:
+		{
+			const double visibleFraction = frustumSolidAngleFraction();
+			const int shellCount = parameters.isAdaptive() ? std::min(parameters.shellCount, adaptiveShellCount(parameters.tolerance)) : parameters.shellCount;
+			for (int n = 0; n < shellCount; n++)
+			{
+				const double volume = HalleyGenerator::shellVolume(n, parameters.shellThickness, parameters.firstShellDistance);
+				double shellStarCount = std::floor(volume / STELLAR_DENSITY) * visibleFraction;
+				if (parameters.isAdaptive()) shellStarCount = std::min(shellStarCount, double(parameters.sampleCount));
+				estimate.shellStarCounts.push_back(shellStarCount);
+			}
+			break;
+		}
+		case clusteringMethod::FRACTAL:
+		{
+			const std::vector<float> volumeRadius = FractalGenerator::calculateVolumeRadius(parameters.levelCount, parameters.countPerLevel, parameters.spacing);
+
+			//Every level is a uniformly filled sphere around the first star
+			const double centerDistance = CAMERA_VFOV / CAMERA_ASPECT_RATIO;
+			double levelCount = 1.;
+			estimate.shellStarCounts.push_back(1.);
+			for (int level = 1; level < parameters.levelCount; level++)
+			{
+				levelCount *= fractalLevelFactor(level, volumeRadius, parameters.spacing);
+				estimate.shellStarCounts.push_back(levelCount * sphereVisibleFraction(centerDistance, volumeRadius[level]));
+			}
+			break;
+		}
+	}
+
+	const double threads = std::max(threadCount, 1);
+	for (const double shellStarCount : estimate.shellStarCounts)
+	{
+		estimate.starCount += shellStarCount;
+		estimate.largestShellStarCount = std::max(estimate.largestShellStarCount, shellStarCount);
+
+		if (throughput.generationStarsPerSecond > 0.) estimate.generationSeconds += shellStarCount / throughput.generationStarsPerSecond;
+
+		if (mode == placementMode::BULK)
+		{
+			estimate.placementSeconds += throughput.bulkPlacementStarsPerSecond > 0. ? shellStarCount / throughput.bulkPlacementStarsPerSecond : throughput.placementTickSeconds;
+			continue;
+		}
+
+		//Every group places one star per tick, the largest group sets the tick count
+		const double stars = std::round(shellStarCount);
+		const double groupSize = std::max(std::floor(stars / threads), double(STARS_PER_GROUP));
+		estimate.placementSeconds += std::min(stars, groupSize) * throughput.placementTickSeconds;
+	}
+	estimate.catalogBytes = estimate.starCount * CATALOG_BYTES_PER_STAR;
+	estimate.compactCatalogBytes = estimate.starCount * COMPACT_CATALOG_BYTES_PER_STAR;
+
+	return estimate;
+}
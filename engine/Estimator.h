@@ -0,0 +1,50 @@
+#pragma once
+
+#include <vector>
+
+#include "SimulationParameters.h"
+
+//Measured speed of this machine, stored from previous runs
+struct Throughput
+{
+	//0 = not measured yet, the stage is left out of the estimate
+	double generationStarsPerSecond = 0.;
+	double bulkPlacementStarsPerSecond = 0.;
+	//Real duration of an animated placement tick, the timer slips when the GUI thread is busy
+	double placementTickSeconds = PLACEMENT_TICK_INTERVAL * 1e-3;
+};
+
+struct RunEstimate
+{
+	//Expected stars in the frustum, per shell/level and in total
+	std::vector<double> shellStarCounts;
+	double starCount = 0.;
+	double largestShellStarCount = 0.;
+
+	double generationSeconds = 0.;
+	double placementSeconds = 0.;
+	double seconds() const { return generationSeconds + placementSeconds; };
+
+	//Positions kept by the engine for the whole run, as floats and as compact grid coordinates
+	double catalogBytes = 0.;
+	double compactCatalogBytes = 0.;
+};
+
+//Closed-form star counts, run time and memory of a run, nothing is generated
+namespace Estimator
+{
+	constexpr double CATALOG_BYTES_PER_STAR = 3 * sizeof(float);
+	//Box corners add well below a byte per star
+	constexpr double COMPACT_CATALOG_BYTES_PER_STAR = 3 * sizeof(uint16_t);
+
+	RunEstimate estimate(const SimulationParameters& parameters, const placementMode mode, const int threadCount, const Throughput& throughput);
+
+	//Fraction of the sky covered by the default camera frustum
+	double frustumSolidAngleFraction();
+	//Fraction of a uniformly filled sphere on the view axis that lies in the frustum
+	double sphereVisibleFraction(const double centerDistance, const double radius);
+	//Expected shells of an adaptive Halley run before it settles, ignoring the sampling error
+	int adaptiveShellCount(const double tolerance);
+	//Size of calculateLevelOffsets without building it
+	long long fractalLevelFactor(const int level, const std::vector<float>& volumeRadius, const float spacing);
+}
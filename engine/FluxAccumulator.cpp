@@ -0,0 +1,77 @@
+#include "FluxAccumulator.h"
+
+#include <cmath>
+
+#include "FluxKernel.h"
+#include "Trace.h"
+
+void CompensatedSum::add(const double value)
+{
+	const double sum = _sum + value;
+	if (std::abs(_sum) >= std::abs(value)) _compensation += (_sum - sum) + value;
+	else _compensation += (value - sum) + _sum;
+	_sum = sum;
+}
+
+void CompensatedSum::add(const CompensatedSum& other)
+{
+	add(other._sum);
+	add(other._compensation);
+}
+
+void FluxAccumulator::clear()
+{
+	_runningFlux = CompensatedSum();
+	_runningStarCount = 0;
+	_runningFluxVariance = 0.;
+	_shellFlux.clear();
+	_cumulativeFlux.clear();
+	_shellFluxVariance.clear();
+	_cumulativeFluxVariance.clear();
+	_shellStarCount.clear();
+	_cumulativeStarCount.clear();
+}
+
+void FluxAccumulator::addShell(const StarShellView& shell, const double weight, const double fluxVariance)
+{
+	OLBERS_TRACE_SCOPE("flux reduction", "brightness");
+	addShellFlux(FluxKernel::sumFlux(shell), shell.size(), weight, fluxVariance);
+}
+
+void FluxAccumulator::addShell(const CompactShell& shell, const double weight, const double fluxVariance)
+{
+	OLBERS_TRACE_SCOPE("flux reduction", "brightness");
+	addShellFlux(FluxKernel::sumFlux(shell), shell.size(), weight, fluxVariance);
+}
+
+void FluxAccumulator::addShellFlux(const double shellFlux, const size_t storedStarCount, const double weight, const double fluxVariance)
+{
+	CompensatedSum shellSum;
+	shellSum.add(weight * shellFlux);
+	const size_t shellStarCount = weight == 1. ? storedStarCount : size_t(std::llround(weight * storedStarCount));
+
+	_runningFlux.add(shellSum);
+	_runningStarCount += shellStarCount;
+	_runningFluxVariance += fluxVariance;
+
+	_shellFlux.push_back(shellSum.value());
+	_cumulativeFlux.push_back(_runningFlux);
+	_shellFluxVariance.push_back(fluxVariance);
+	_cumulativeFluxVariance.push_back(_runningFluxVariance);
+	_shellStarCount.push_back(shellStarCount);
+	_cumulativeStarCount.push_back(_runningStarCount);
+}
+
+void FluxAccumulator::restoreShell(const size_t shellStarCount, const double shellFlux, const CompensatedSum& cumulativeFlux)
+{
+	_runningFlux = cumulativeFlux;
+	_runningStarCount += shellStarCount;
+
+	_shellFlux.push_back(shellFlux);
+	_cumulativeFlux.push_back(_runningFlux);
+	//Checkpoints are only written by exact runs
+	_shellFluxVariance.push_back(0.);
+	_cumulativeFluxVariance.push_back(_runningFluxVariance);
+	_shellStarCount.push_back(shellStarCount);
+	_cumulativeStarCount.push_back(_runningStarCount);
+}
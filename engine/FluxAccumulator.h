@@ -0,0 +1,62 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+
+#include "StarCatalog.h"
+
+//Neumaier compensated summation
+class CompensatedSum
+{
+public:
+	CompensatedSum() = default;
+	CompensatedSum(const double sum, const double compensation) : _sum(sum), _compensation(compensation) {};
+
+	void add(const double value);
+	void add(const CompensatedSum& other);
+	double value() const { return _sum + _compensation; };
+
+	double sum() const { return _sum; };
+	double compensation() const { return _compensation; };
+
+private:
+	double _sum = 0.;
+	double _compensation = 0.;
+};
+
+//Running per-shell flux sums, each star's flux is computed once when its shell is added
+class FluxAccumulator
+{
+public:
+	void clear();
+	//A sampled shell's stars stand for weight stars each, the variance of its flux estimate is kept alongside
+	void addShell(const StarShellView& shell, const double weight = 1., const double fluxVariance = 0.);
+	void addShell(const CompactShell& shell, const double weight = 1., const double fluxVariance = 0.);
+	//Appends a shell from its stored sums, e.g. from a checkpoint, without its stars
+	void restoreShell(const size_t shellStarCount, const double shellFlux, const CompensatedSum& cumulativeFlux);
+
+	int shellCount() const { return int(_shellFlux.size()); };
+
+	double shellFlux(const int shellIndex) const { return _shellFlux[shellIndex]; };
+	double cumulativeFlux(const int shellIndex) const { return _cumulativeFlux[shellIndex].value(); };
+	const CompensatedSum& cumulativeFluxSum(const int shellIndex) const { return _cumulativeFlux[shellIndex]; };
+	double shellFluxVariance(const int shellIndex) const { return _shellFluxVariance[shellIndex]; };
+	double cumulativeFluxVariance(const int shellIndex) const { return _cumulativeFluxVariance[shellIndex]; };
+
+	size_t shellStarCount(const int shellIndex) const { return _shellStarCount[shellIndex]; };
+	size_t cumulativeStarCount(const int shellIndex) const { return _cumulativeStarCount[shellIndex]; };
+
+private:
+	CompensatedSum _runningFlux;
+	size_t _runningStarCount = 0;
+	double _runningFluxVariance = 0.;
+
+	std::vector<double> _shellFlux;
+	std::vector<CompensatedSum> _cumulativeFlux;
+	std::vector<double> _shellFluxVariance;
+	std::vector<double> _cumulativeFluxVariance;
+	std::vector<size_t> _shellStarCount;
+	std::vector<size_t> _cumulativeStarCount;
+
+	void addShellFlux(const double shellFlux, const size_t storedStarCount, const double weight, const double fluxVariance);
+};
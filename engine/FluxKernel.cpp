@@ -0,0 +1,161 @@
+#include "FluxKernel.h"
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include "Global.h"
+#include "Simd.h"
+#include "Parallel.h"
+
+static double sumInverseSquareScalar(const float* x, const float* y, const float* z, const size_t count, const float originX, const float originY, const float originZ)
+{
+	double sum = 0.;
+	for (size_t i = 0; i < count; i++)
+	{
+		const float px = originX + x[i];
+		const float py = originY + y[i];
+		const float pz = originZ + z[i];
+		const float distanceSquared = px * px + py * py + pz * pz;
+		sum += double(1.f / distanceSquared);
+	}
+	return sum;
+}
+
+#if OLBERS_SIMD_X86
+OLBERS_TARGET_SSE static double sumInverseSquareSse(const float* x, const float* y, const float* z, const size_t count, const float originX, const float originY, const float originZ)
+{
+	const __m128 ox = _mm_set1_ps(originX);
+	const __m128 oy = _mm_set1_ps(originY);
+	const __m128 oz = _mm_set1_ps(originZ);
+	const __m128 one = _mm_set1_ps(1.f);
+	__m128d sumLow = _mm_setzero_pd();
+	__m128d sumHigh = _mm_setzero_pd();
+
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		const __m128 px = _mm_add_ps(ox, _mm_loadu_ps(x + i));
+		const __m128 py = _mm_add_ps(oy, _mm_loadu_ps(y + i));
+		const __m128 pz = _mm_add_ps(oz, _mm_loadu_ps(z + i));
+		const __m128 distanceSquared = _mm_add_ps(_mm_add_ps(_mm_mul_ps(px, px), _mm_mul_ps(py, py)), _mm_mul_ps(pz, pz));
+		const __m128 inverse = _mm_div_ps(one, distanceSquared);
+		sumLow = _mm_add_pd(sumLow, _mm_cvtps_pd(inverse));
+		sumHigh = _mm_add_pd(sumHigh, _mm_cvtps_pd(_mm_movehl_ps(inverse, inverse)));
+	}
+
+	double lanes[2];
+	_mm_storeu_pd(lanes, _mm_add_pd(sumLow, sumHigh));
+	return lanes[0] + lanes[1] + sumInverseSquareScalar(x + i, y + i, z + i, count - i, originX, originY, originZ);
+}
+
+OLBERS_TARGET_AVX2 static double sumInverseSquareAvx2(const float* x, const float* y, const float* z, const size_t count, const float originX, const float originY, const float originZ)
+{
+	const __m256 ox = _mm256_set1_ps(originX);
+	const __m256 oy = _mm256_set1_ps(originY);
+	const __m256 oz = _mm256_set1_ps(originZ);
+	const __m256 one = _mm256_set1_ps(1.f);
+	__m256d sumLow = _mm256_setzero_pd();
+	__m256d sumHigh = _mm256_setzero_pd();
+
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		const __m256 px = _mm256_add_ps(ox, _mm256_loadu_ps(x + i));
+		const __m256 py = _mm256_add_ps(oy, _mm256_loadu_ps(y + i));
+		const __m256 pz = _mm256_add_ps(oz, _mm256_loadu_ps(z + i));
+		const __m256 distanceSquared = _mm256_fmadd_ps(pz, pz, _mm256_fmadd_ps(py, py, _mm256_mul_ps(px, px)));
+		const __m256 inverse = _mm256_div_ps(one, distanceSquared);
+		sumLow = _mm256_add_pd(sumLow, _mm256_cvtps_pd(_mm256_castps256_ps128(inverse)));
+		sumHigh = _mm256_add_pd(sumHigh, _mm256_cvtps_pd(_mm256_extractf128_ps(inverse, 1)));
+	}
+
+	double lanes[4];
+	_mm256_storeu_pd(lanes, _mm256_add_pd(sumLow, sumHigh));
+	return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + sumInverseSquareScalar(x + i, y + i, z + i, count - i, originX, originY, originZ);
+}
+#endif
+
+double FluxKernel::fluxAtOneParsec()
+{
+	static const double flux = std::pow(10., -0.4 * (ABSOLUTE_VISUAL_MAGNITUDE - 5.));
+	return flux;
+}
+
+double FluxKernel::sumInverseSquare(const float* x, const float* y, const float* z, const size_t count, const float originX, const float originY, const float originZ)
+{
+#if OLBERS_SIMD_X86
+	switch (Simd::level())
+	{
+		case SimdLevel::AVX2: return sumInverseSquareAvx2(x, y, z, count, originX, originY, originZ);
+		case SimdLevel::SSE: return sumInverseSquareSse(x, y, z, count, originX, originY, originZ);
+		case SimdLevel::SCALAR: break;
+	}
+#endif
+	return sumInverseSquareScalar(x, y, z, count, originX, originY, originZ);
+}
+
+double FluxKernel::sumFlux(const float* x, const float* y, const float* z, const size_t count)
+{
+	return sumFlux(StarShellView(x, y, z, count));
+}
+
+//Pairwise tree reduction of the chunk sums, the order only depends on the chunk count
+static double reduceChunks(std::vector<double>& partialSums)
+{
+	const size_t chunkCount = partialSums.size();
+	for (size_t stride = 1; stride < chunkCount; stride *= 2)
+	{
+		for (size_t i = 0; i + stride < chunkCount; i += 2 * stride) partialSums[i] += partialSums[i + stride];
+	}
+
+	return chunkCount == 0 ? 0. : partialSums[0] * FluxKernel::fluxAtOneParsec();
+}
+
+double FluxKernel::sumFlux(const StarShellView& shell)
+{
+	const size_t count = shell.size();
+	const size_t chunkCount = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	std::vector<double> partialSums(chunkCount, 0.);
+
+	//Flux only needs the relative precision of float, anchors are added in float within the kernel
+	Parallel::forEach(chunkCount, [&](size_t chunk)
+	{
+		const size_t begin = chunk * CHUNK_SIZE;
+		shell.forEachSegment(begin, std::min(begin + CHUNK_SIZE, count), [&](const StarAnchor& anchor, const size_t first, const size_t last)
+		{
+			partialSums[chunk] += sumInverseSquare(shell.x + first, shell.y + first, shell.z + first, last - first, float(anchor.x), float(anchor.y), float(anchor.z));
+		});
+	});
+
+	return reduceChunks(partialSums);
+}
+
+double FluxKernel::sumFlux(const CompactShell& shell)
+{
+	const size_t count = shell.size();
+	const size_t chunkCount = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	std::vector<double> partialSums(chunkCount, 0.);
+
+	//Grid offsets are decoded a box at a time, they are exact in float so the sum equals the decoded shell's
+	Parallel::forEach(chunkCount, [&](size_t chunk)
+	{
+		std::vector<float> x(CompactShell::BOX_STAR_COUNT);
+		std::vector<float> y(CompactShell::BOX_STAR_COUNT);
+		std::vector<float> z(CompactShell::BOX_STAR_COUNT);
+		const size_t begin = chunk * CHUNK_SIZE;
+		shell.forEachBox(begin, std::min(begin + CHUNK_SIZE, count), [&](const CompactBox& box, const size_t first, const size_t last)
+		{
+			const float step = std::ldexp(1.f, box.exponent);
+			for (size_t i = first; i < last; i++)
+			{
+				x[i - first] = float(shell.x[i]) * step;
+				y[i - first] = float(shell.y[i]) * step;
+				z[i - first] = float(shell.z[i]) * step;
+			}
+			partialSums[chunk] += sumInverseSquare(x.data(), y.data(), z.data(), last - first, float(box.x), float(box.y), float(box.z));
+		});
+	});
+
+	return reduceChunks(partialSums);
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <cstddef>
+
+#include "StarCatalog.h"
+
+//Apparent flux reduction over structure-of-arrays positions.
+//flux = 10^(-0.4 * (M + 5 * log10(d / 10))) = FLUX_AT_ONE_PARSEC / d^2
+namespace FluxKernel
+{
+	//Stars per reduction chunk, fixed so that the result doesn't depend on the thread count
+	constexpr size_t CHUNK_SIZE = 1 << 16;
+
+	double fluxAtOneParsec();
+
+	//Sum of 1/d^2 for a single chunk using the best available instruction set, positions are offsets from the origin
+	double sumInverseSquare(const float* x, const float* y, const float* z, const size_t count, const float originX = 0.f, const float originY = 0.f, const float originZ = 0.f);
+
+	//Total apparent flux of all stars, split across threads and tree-reduced in a fixed order
+	double sumFlux(const float* x, const float* y, const float* z, const size_t count);
+	double sumFlux(const StarShellView& shell);
+	//Same sum over 16 bit grid positions, decoded on the fly
+	double sumFlux(const CompactShell& shell);
+}
@@ -0,0 +1,177 @@
+#include "FractalGenerator.h"
+
+#include <cassert>
+#include <cmath>
+
+#include "Global.h"
+#include "Trace.h"
+
+FractalGenerator::FractalGenerator(int levelCount, int countPerLevel, float spacing, bool placeZeroStar)
+{
+	_levelCount = levelCount;
+	_countPerLevel = countPerLevel;
+	_spacing = spacing;
+	_placeZeroStar = placeZeroStar;
+}
+
+std::vector<float> FractalGenerator::calculateVolumeRadius(int levelCount, int countPerLevel, float spacing)
+{
+	std::vector<float> volumeRadius;
+	for (int level = 0; level < levelCount; level++)
+	{
+		const float prevRadius = level == 0 ? STELLAR_RADIUS : volumeRadius.back();
+		const float radius = (countPerLevel - 1.f) * (spacing + 2.f * prevRadius) + prevRadius;
+		volumeRadius.push_back(radius);
+	}
+	return volumeRadius;
+}
+
+float FractalGenerator::calculateMaxOffset(int level, const std::vector<float>& volumeRadius)
+{
+	return float(volumeRadius[level]) + (1.f/2.f) * float(volumeRadius[level - 1]);
+}
+
+void FractalGenerator::calculateLevelOffsets(int level, const std::vector<float>& volumeRadius, const float spacing, StarShell& outOffsets)
+{
+	assert(level > 0 && level < int(volumeRadius.size()));
+	const float increment = (2 * volumeRadius[level - 1]) + spacing;
+	const float maxExtent = volumeRadius[level] - volumeRadius[level - 1];
+	const double maxLength = calculateMaxOffset(level, volumeRadius);
+
+	//Integer lattice of (2 * steps + 1)^3 cells clipped to a sphere, maxExtent is a whole number of increments
+	const int steps = int(std::lround(maxExtent / increment));
+	const double maxLengthSquared = (maxLength * maxLength) / (double(increment) * increment);
+	outOffsets.reserve(outOffsets.size() + size_t(2 * steps + 1) * (2 * steps + 1) * (2 * steps + 1));
+	for (int i = -steps; i <= steps; i++)
+	{
+		for (int j = -steps; j <= steps; j++)
+		{
+			for (int k = -steps; k <= steps; k++)
+			{
+				if (double(i * i + j * j + k * k) >= maxLengthSquared) continue;
+				outOffsets.append(i * increment, j * increment, k * increment);
+			}
+		}
+	}
+}
+
+void FractalGenerator::translate(const StarShell& offsets, float originX, float originY, float originZ, StarShell& outPositions)
+{
+	const size_t first = outPositions.size();
+	const size_t count = offsets.size();
+	outPositions.x.resize(first + count);
+	outPositions.y.resize(first + count);
+	outPositions.z.resize(first + count);
+
+	float* x = outPositions.x.data() + first;
+	float* y = outPositions.y.data() + first;
+	float* z = outPositions.z.data() + first;
+	for (size_t i = 0; i < count; i++) x[i] = offsets.x[i] + originX;
+	for (size_t i = 0; i < count; i++) y[i] = offsets.y[i] + originY;
+	for (size_t i = 0; i < count; i++) z[i] = offsets.z[i] + originZ;
+}
+
+void FractalGenerator::calculateLevel(int level, float originX, float originY, float originZ, const std::vector<float>& volumeRadius, const float spacing, StarShell& outPositions)
+{
+	StarShell offsets;
+	calculateLevelOffsets(level, volumeRadius, spacing, offsets);
+	translate(offsets, originX, originY, originZ, outPositions);
+}
+
+void FractalGenerator::generate(const Frustum& frustum, ShellSink& outShells, const int firstShell, const CancellationToken& cancellation)
+{
+	const std::vector<float> volumeRadius = calculateVolumeRadius(_levelCount, _countPerLevel, _spacing);
+
+	//Radius around a star of a level containing every star expanded from it in the later levels, padded against float rounding
+	std::vector<float> subtreeRadius(_levelCount, 0.f);
+	for (int levelIndex = _levelCount - 2; levelIndex >= 0; levelIndex--)
+	{
+		subtreeRadius[levelIndex] = subtreeRadius[levelIndex + 1] + calculateMaxOffset(levelIndex + 1, volumeRadius) * 1.0001f;
+	}
+
+	//The offsets around a parent only depend on the level
+	std::vector<StarShell> levelOffsets(_levelCount);
+	for (int levelIndex = 1; levelIndex < _levelCount; levelIndex++) calculateLevelOffsets(levelIndex, volumeRadius, _spacing, levelOffsets[levelIndex]);
+
+	//Stars of the current level whose subtree isn't entirely outside the frustum, and whether it's entirely inside.
+	//Every parent anchors its stars in double, their offsets stay within the parent's cluster
+	StarShell level;
+	std::vector<bool> levelInside;
+	level.append(0.f, 0.f, -CAMERA_VFOV / CAMERA_ASPECT_RATIO);
+	levelInside.push_back(false);
+
+	for (int levelIndex = 0; levelIndex < _levelCount; levelIndex++)
+	{
+		OLBERS_TRACE_SCOPE("fractal level", "generation");
+
+		//Levels before firstShell are only expanded
+		const bool emitLevel = levelIndex >= firstShell;
+
+		//Hierarchical culling: prune subtrees outside the frustum, accept the ones inside without testing their stars
+		std::vector<double> keptX;
+		std::vector<double> keptY;
+		std::vector<double> keptZ;
+		std::vector<bool> keptInside;
+		StarShell visible;
+		StarShell uncertain;
+		const StarAnchor* visibleAnchor = nullptr;
+		const StarAnchor* uncertainAnchor = nullptr;
+		StarShellView(level).forEachSegment(0, level.size(), [&](const StarAnchor& anchor, const size_t first, const size_t last)
+		{
+			for (size_t i = first; i < last; i++)
+			{
+				const double x = anchor.x + level.x[i];
+				const double y = anchor.y + level.y[i];
+				const double z = anchor.z + level.z[i];
+				bool inside = levelInside[i];
+				if (!inside)
+				{
+					const FrustumIntersection intersection = frustum.classifySphere(x, y, z, subtreeRadius[levelIndex]);
+					if (intersection == FrustumIntersection::OUTSIDE) continue;
+					inside = intersection == FrustumIntersection::INSIDE;
+				}
+
+				if (emitLevel)
+				{
+					StarShell& target = inside ? visible : uncertain;
+					const StarAnchor*& targetAnchor = inside ? visibleAnchor : uncertainAnchor;
+					if (targetAnchor != &anchor && !level.anchors.empty()) target.anchor(anchor.x, anchor.y, anchor.z);
+					targetAnchor = &anchor;
+					target.append(level.x[i], level.y[i], level.z[i]);
+				}
+
+				keptX.push_back(x);
+				keptY.push_back(y);
+				keptZ.push_back(z);
+				keptInside.push_back(inside);
+			}
+		});
+		level = StarShell();
+		levelInside.clear();
+
+		if (emitLevel)
+		{
+			//Occlusion culling
+			frustum.cull(uncertain, visible);
+			uncertain = StarShell();
+
+			visible.sortByDistance();
+			outShells.addShell(std::move(visible));
+		}
+
+		if (levelIndex == _levelCount - 1) break;
+
+		//Expand the kept stars into the next level
+		const StarShell& offsets = levelOffsets[levelIndex + 1];
+		level.reserve(keptX.size() * offsets.size());
+		level.anchors.reserve(keptX.size());
+		levelInside.reserve(keptX.size() * offsets.size());
+		for (size_t i = 0; i < keptX.size(); i++)
+		{
+			if (cancellation.isCancelled()) return;
+			level.anchor(keptX[i], keptY[i], keptZ[i]);
+			translate(offsets, 0.f, 0.f, 0.f, level);
+			levelInside.resize(level.size(), keptInside[i]);
+		}
+	}
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "StarGenerator.h"
+
+class FractalGenerator : public StarGenerator
+{
+public:
+	FractalGenerator(int levelCount, int countPerLevel, float spacing, bool placeZeroStar);
+
+	virtual void generate(const Frustum& frustum, ShellSink& outShells, const int firstShell, const CancellationToken& cancellation) override;
+
+	static std::vector<float> calculateVolumeRadius(int levelCount, int countPerLevel, float spacing);
+	//Upper bound of the distance between a star and the stars calculateLevel places around it
+	static float calculateMaxOffset(int level, const std::vector<float>& volumeRadius);
+	//Offsets of the stars placed around any parent star of a level, on an integer lattice
+	static void calculateLevelOffsets(int level, const std::vector<float>& volumeRadius, const float spacing, StarShell& outOffsets);
+	static void translate(const StarShell& offsets, float originX, float originY, float originZ, StarShell& outPositions);
+	static void calculateLevel(int level, float originX, float originY, float originZ, const std::vector<float>& volumeRadius, const float spacing, StarShell& outPositions);
+
+private:
+	int _levelCount;
+	int _countPerLevel;
+	float _spacing;
+	bool _placeZeroStar;
+};
@@ -0,0 +1,394 @@
+#include "Frustum.h"
+
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+#include "Simd.h"
+#include "Parallel.h"
+#include "Trace.h"
+
+typedef float FrustumPlanes[6][4];
+
+//Tests count points, writes the visible ones to outX/Y/Z if they aren't null. Returns the visible count
+static size_t cullChunkScalar(const FrustumPlanes& planes, const float* x, const float* y, const float* z, const size_t count, float* outX, float* outY, float* outZ)
+{
+	size_t visible = 0;
+	for (size_t i = 0; i < count; i++)
+	{
+		bool inside = true;
+		for (int plane = 0; plane < 6; plane++)
+		{
+			inside &= planes[plane][0] * x[i] + planes[plane][1] * y[i] + planes[plane][2] * z[i] + planes[plane][3] > 0.f;
+		}
+		if (!inside) continue;
+
+		if (outX)
+		{
+			outX[visible] = x[i];
+			outY[visible] = y[i];
+			outZ[visible] = z[i];
+		}
+		visible++;
+	}
+	return visible;
+}
+
+#if OLBERS_SIMD_X86
+OLBERS_TARGET_SSE static size_t cullChunkSse(const FrustumPlanes& planes, const float* x, const float* y, const float* z, const size_t count, float* outX, float* outY, float* outZ)
+{
+	__m128 a[6], b[6], c[6], d[6];
+	for (int plane = 0; plane < 6; plane++)
+	{
+		a[plane] = _mm_set1_ps(planes[plane][0]);
+		b[plane] = _mm_set1_ps(planes[plane][1]);
+		c[plane] = _mm_set1_ps(planes[plane][2]);
+		d[plane] = _mm_set1_ps(planes[plane][3]);
+	}
+	const __m128 zero = _mm_setzero_ps();
+
+	size_t visible = 0;
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4)
+	{
+		const __m128 px = _mm_loadu_ps(x + i);
+		const __m128 py = _mm_loadu_ps(y + i);
+		const __m128 pz = _mm_loadu_ps(z + i);
+
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int plane = 0; plane < 6; plane++)
+		{
+			const __m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[plane], px), _mm_mul_ps(b[plane], py)), _mm_add_ps(_mm_mul_ps(c[plane], pz), d[plane]));
+			inside = _mm_and_ps(inside, _mm_cmpgt_ps(distance, zero));
+		}
+
+		int mask = _mm_movemask_ps(inside);
+		if (!outX)
+		{
+			visible += Simd::popCount(mask);
+			continue;
+		}
+		while (mask)
+		{
+			const int lane = Simd::countTrailingZeros(mask);
+			outX[visible] = x[i + lane];
+			outY[visible] = y[i + lane];
+			outZ[visible] = z[i + lane];
+			visible++;
+			mask &= mask - 1;
+		}
+	}
+
+	const size_t tailVisible = cullChunkScalar(planes, x + i, y + i, z + i, count - i, outX ? outX + visible : nullptr, outY ? outY + visible : nullptr, outZ ? outZ + visible : nullptr);
+	return visible + tailVisible;
+}
+
+OLBERS_TARGET_AVX2 static size_t cullChunkAvx2(const FrustumPlanes& planes, const float* x, const float* y, const float* z, const size_t count, float* outX, float* outY, float* outZ)
+{
+	__m256 a[6], b[6], c[6], d[6];
+	for (int plane = 0; plane < 6; plane++)
+	{
+		a[plane] = _mm256_set1_ps(planes[plane][0]);
+		b[plane] = _mm256_set1_ps(planes[plane][1]);
+		c[plane] = _mm256_set1_ps(planes[plane][2]);
+		d[plane] = _mm256_set1_ps(planes[plane][3]);
+	}
+	const __m256 zero = _mm256_setzero_ps();
+
+	size_t visible = 0;
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8)
+	{
+		const __m256 px = _mm256_loadu_ps(x + i);
+		const __m256 py = _mm256_loadu_ps(y + i);
+		const __m256 pz = _mm256_loadu_ps(z + i);
+
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (int plane = 0; plane < 6; plane++)
+		{
+			const __m256 distance = _mm256_fmadd_ps(a[plane], px, _mm256_fmadd_ps(b[plane], py, _mm256_fmadd_ps(c[plane], pz, d[plane])));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, zero, _CMP_GT_OQ));
+		}
+
+		int mask = _mm256_movemask_ps(inside);
+		if (!outX)
+		{
+			visible += Simd::popCount(mask);
+			continue;
+		}
+		while (mask)
+		{
+			const int lane = Simd::countTrailingZeros(mask);
+			outX[visible] = x[i + lane];
+			outY[visible] = y[i + lane];
+			outZ[visible] = z[i + lane];
+			visible++;
+			mask &= mask - 1;
+		}
+	}
+
+	const size_t tailVisible = cullChunkScalar(planes, x + i, y + i, z + i, count - i, outX ? outX + visible : nullptr, outY ? outY + visible : nullptr, outZ ? outZ + visible : nullptr);
+	return visible + tailVisible;
+}
+#endif
+
+static size_t cullChunk(const FrustumPlanes& planes, const float* x, const float* y, const float* z, const size_t count, float* outX, float* outY, float* outZ)
+{
+#if OLBERS_SIMD_X86
+	switch (Simd::level())
+	{
+		case SimdLevel::AVX2: return cullChunkAvx2(planes, x, y, z, count, outX, outY, outZ);
+		case SimdLevel::SSE: return cullChunkSse(planes, x, y, z, count, outX, outY, outZ);
+		case SimdLevel::SCALAR: break;
+	}
+#endif
+	return cullChunkScalar(planes, x, y, z, count, outX, outY, outZ);
+}
+
+Frustum::Frustum()
+{
+	_viewProjectionMatrix = identity();
+	extractPlanes();
+}
+
+Frustum::Frustum(const float* viewProjectionMatrix)
+{
+	for (int i = 0; i < 16; i++) _viewProjectionMatrix[i] = viewProjectionMatrix[i];
+	extractPlanes();
+}
+
+void Frustum::extractPlanes()
+{
+	//Gribb/Hartmann: clip space -w < x, y, z < w expressed as planes from the matrix rows
+	const Matrix4& m = _viewProjectionMatrix;
+	for (int axis = 0; axis < 3; axis++)
+	{
+		for (int col = 0; col < 4; col++)
+		{
+			const float w = m[col * 4 + 3];
+			const float v = m[col * 4 + axis];
+			_planes[axis * 2][col] = w + v;
+			_planes[axis * 2 + 1][col] = w - v;
+		}
+	}
+
+	for (int plane = 0; plane < 6; plane++)
+	{
+		_planeNormalLengths[plane] = std::sqrt(_planes[plane][0] * _planes[plane][0] + _planes[plane][1] * _planes[plane][1] + _planes[plane][2] * _planes[plane][2]);
+	}
+}
+
+Matrix4 Frustum::identity()
+{
+	Matrix4 m{};
+	m[0] = m[5] = m[10] = m[15] = 1.f;
+	return m;
+}
+
+Matrix4 Frustum::perspective(const float verticalAngle, const float aspectRatio, const float nearPlane, const float farPlane)
+{
+	//Same as QMatrix4x4::perspective
+	const float radians = (verticalAngle / 2.f) * float(M_PI) / 180.f;
+	const float cotan = std::cos(radians) / std::sin(radians);
+	const float clip = farPlane - nearPlane;
+
+	Matrix4 m{};
+	m[0] = cotan / aspectRatio;
+	m[5] = cotan;
+	m[10] = -(nearPlane + farPlane) / clip;
+	m[11] = -1.f;
+	m[14] = -(2.f * nearPlane * farPlane) / clip;
+	return m;
+}
+
+Matrix4 Frustum::multiply(const Matrix4& a, const Matrix4& b)
+{
+	Matrix4 m{};
+	for (int col = 0; col < 4; col++)
+	{
+		for (int row = 0; row < 4; row++)
+		{
+			float sum = 0.f;
+			for (int k = 0; k < 4; k++) sum += a[k * 4 + row] * b[col * 4 + k];
+			m[col * 4 + row] = sum;
+		}
+	}
+	return m;
+}
+
+bool Frustum::isPointVisible(const float x, const float y, const float z) const
+{
+	return cullChunkScalar(_planes, &x, &y, &z, 1, nullptr, nullptr, nullptr) == 1;
+}
+
+size_t Frustum::cull(const float* x, const float* y, const float* z, const size_t count, StarShell& outVisible) const
+{
+	OLBERS_TRACE_SCOPE("cull", "culling");
+	const size_t chunkCount = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+	//Count pass, then an exclusive prefix sum gives every chunk its output range
+	std::vector<size_t> offsets(chunkCount + 1, 0);
+	Parallel::forEach(chunkCount, [&](size_t chunk)
+	{
+		const size_t begin = chunk * CHUNK_SIZE;
+		offsets[chunk + 1] = cullChunk(_planes, x + begin, y + begin, z + begin, std::min(CHUNK_SIZE, count - begin), nullptr, nullptr, nullptr);
+	});
+	for (size_t chunk = 0; chunk < chunkCount; chunk++) offsets[chunk + 1] += offsets[chunk];
+
+	const size_t firstOutput = outVisible.size();
+	const size_t visibleCount = offsets[chunkCount];
+	outVisible.x.resize(firstOutput + visibleCount);
+	outVisible.y.resize(firstOutput + visibleCount);
+	outVisible.z.resize(firstOutput + visibleCount);
+
+	//Compaction pass
+	Parallel::forEach(chunkCount, [&](size_t chunk)
+	{
+		const size_t begin = chunk * CHUNK_SIZE;
+		const size_t output = firstOutput + offsets[chunk];
+		cullChunk(_planes, x + begin, y + begin, z + begin, std::min(CHUNK_SIZE, count - begin), outVisible.x.data() + output, outVisible.y.data() + output, outVisible.z.data() + output);
+	});
+
+	return visibleCount;
+}
+
+size_t Frustum::cull(const StarShellView& points, StarShell& outVisible) const
+{
+	if (points.anchorCount == 0)
+	{
+		if (!outVisible.anchors.empty()) outVisible.anchor(0., 0., 0.);
+		return cull(points.x, points.y, points.z, points.size(), outVisible);
+	}
+
+	OLBERS_TRACE_SCOPE("cull", "culling");
+	const size_t count = points.size();
+	const size_t chunkCount = (count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+
+	//Every chunk culls its part of each anchor in the anchor's frame. Count pass, keeping the visible count of every part
+	std::vector<std::vector<size_t>> partCounts(chunkCount);
+	Parallel::forEach(chunkCount, [&](size_t chunk)
+	{
+		const size_t begin = chunk * CHUNK_SIZE;
+		points.forEachSegment(begin, std::min(begin + CHUNK_SIZE, count), [&](const StarAnchor& anchor, const size_t first, const size_t last)
+		{
+			FrustumPlanes planes;
+			anchorPlanes(anchor, planes);
+			partCounts[chunk].push_back(cullChunk(planes, points.x + first, points.y + first, points.z + first, last - first, nullptr, nullptr, nullptr));
+		});
+	});
+
+	//Output anchors in order, an anchor split between chunks is only added once
+	if (outVisible.anchors.empty() && !outVisible.empty()) outVisible.anchors.push_back({0., 0., 0., 0});
+	const size_t firstOutput = outVisible.size();
+	std::vector<size_t> offsets(chunkCount + 1, 0);
+	size_t visibleCount = 0;
+	const StarAnchor* lastAnchor = nullptr;
+	for (size_t chunk = 0; chunk < chunkCount; chunk++)
+	{
+		offsets[chunk] = visibleCount;
+		size_t part = 0;
+		const size_t begin = chunk * CHUNK_SIZE;
+		points.forEachSegment(begin, std::min(begin + CHUNK_SIZE, count), [&](const StarAnchor& anchor, size_t, size_t)
+		{
+			const size_t partCount = partCounts[chunk][part++];
+			if (partCount == 0) return;
+			if (&anchor != lastAnchor)
+			{
+				if (!outVisible.anchors.empty() && outVisible.anchors.back().begin == firstOutput + visibleCount) outVisible.anchors.pop_back();
+				outVisible.anchors.push_back({anchor.x, anchor.y, anchor.z, firstOutput + visibleCount});
+			}
+			lastAnchor = &anchor;
+			visibleCount += partCount;
+		});
+	}
+
+	outVisible.x.resize(firstOutput + visibleCount);
+	outVisible.y.resize(firstOutput + visibleCount);
+	outVisible.z.resize(firstOutput + visibleCount);
+
+	//Compaction pass
+	Parallel::forEach(chunkCount, [&](size_t chunk)
+	{
+		size_t output = firstOutput + offsets[chunk];
+		const size_t begin = chunk * CHUNK_SIZE;
+		points.forEachSegment(begin, std::min(begin + CHUNK_SIZE, count), [&](const StarAnchor& anchor, const size_t first, const size_t last)
+		{
+			FrustumPlanes planes;
+			anchorPlanes(anchor, planes);
+			output += cullChunk(planes, points.x + first, points.y + first, points.z + first, last - first, outVisible.x.data() + output, outVisible.y.data() + output, outVisible.z.data() + output);
+		});
+	});
+
+	return visibleCount;
+}
+
+void Frustum::anchorPlanes(const StarAnchor& anchor, float outPlanes[6][4]) const
+{
+	for (int plane = 0; plane < 6; plane++)
+	{
+		for (int i = 0; i < 3; i++) outPlanes[plane][i] = _planes[plane][i];
+		outPlanes[plane][3] = float(double(_planes[plane][0]) * anchor.x + double(_planes[plane][1]) * anchor.y + double(_planes[plane][2]) * anchor.z + _planes[plane][3]);
+	}
+}
+
+FrustumIntersection Frustum::classifySphere(const double x, const double y, const double z, const double radius) const
+{
+	FrustumIntersection result = FrustumIntersection::INSIDE;
+	for (int plane = 0; plane < 6; plane++)
+	{
+		const double distance = (_planes[plane][0] * x + _planes[plane][1] * y + _planes[plane][2] * z + _planes[plane][3]) / _planeNormalLengths[plane];
+		if (distance <= -radius) return FrustumIntersection::OUTSIDE;
+		if (distance <= radius) result = FrustumIntersection::INTERSECTING;
+	}
+	return result;
+}
+
+DirectionCone Frustum::boundingCone() const
+{
+	DirectionCone fullSphere;
+
+	//Left, right, bottom and top planes must all pass through the origin
+	for (int plane = 0; plane < 4; plane++)
+	{
+		const double normalLength = std::sqrt(double(_planes[plane][0]) * _planes[plane][0] + double(_planes[plane][1]) * _planes[plane][1] + double(_planes[plane][2]) * _planes[plane][2]);
+		if (normalLength == 0. || std::abs(_planes[plane][3]) > 1e-5 * normalLength) return fullSphere;
+	}
+
+	//Edge rays of the pyramid, in order around the view axis
+	const int edgePlanes[4][2] = {{0, 2}, {2, 1}, {1, 3}, {3, 0}};
+	double edges[4][3];
+	double axis[3] = {0., 0., 0.};
+	for (int edge = 0; edge < 4; edge++)
+	{
+		const float* a = _planes[edgePlanes[edge][0]];
+		const float* b = _planes[edgePlanes[edge][1]];
+		double direction[3] = {double(a[1]) * b[2] - double(a[2]) * b[1], double(a[2]) * b[0] - double(a[0]) * b[2], double(a[0]) * b[1] - double(a[1]) * b[0]};
+
+		//Point the ray away from the camera, the near plane normal faces into the frustum
+		const double facing = direction[0] * _planes[4][0] + direction[1] * _planes[4][1] + direction[2] * _planes[4][2];
+		const double length = std::sqrt(direction[0] * direction[0] + direction[1] * direction[1] + direction[2] * direction[2]);
+		if (length == 0. || facing == 0.) return fullSphere;
+		const double sign = facing > 0. ? 1. : -1.;
+
+		for (int i = 0; i < 3; i++)
+		{
+			edges[edge][i] = sign * direction[i] / length;
+			axis[i] += edges[edge][i];
+		}
+	}
+
+	const double axisLength = std::sqrt(axis[0] * axis[0] + axis[1] * axis[1] + axis[2] * axis[2]);
+	if (axisLength == 0.) return fullSphere;
+
+	DirectionCone cone;
+	double cosHalfAngle = 1.;
+	for (int i = 0; i < 3; i++) cone.axis[i] = float(axis[i] / axisLength);
+	for (int edge = 0; edge < 4; edge++)
+	{
+		cosHalfAngle = std::min(cosHalfAngle, (edges[edge][0] * axis[0] + edges[edge][1] * axis[1] + edges[edge][2] * axis[2]) / axisLength);
+	}
+
+	//Small margin so that float rounding can't drop points on the frustum edges
+	cone.cosHalfAngle = float(std::max(cosHalfAngle - 1e-5, -1.));
+	return cone;
+}
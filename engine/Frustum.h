@@ -0,0 +1,66 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+
+#include "StarCatalog.h"
+
+//Column-major 4x4 matrix, same memory layout as QMatrix4x4::constData()
+using Matrix4 = std::array<float, 16>;
+
+//Directions within an angle of the axis, as seen from the origin
+struct DirectionCone
+{
+	std::array<float, 3> axis{0.f, 0.f, -1.f};
+	float cosHalfAngle = -1.f;
+
+	//Fraction of the full sphere covered by the cone
+	double solidAngleFraction() const { return (1. - double(cosHalfAngle)) / 2.; };
+};
+
+enum class FrustumIntersection
+{
+	OUTSIDE,
+	INTERSECTING,
+	INSIDE
+};
+
+class Frustum
+{
+public:
+	Frustum();
+	explicit Frustum(const float* viewProjectionMatrix);
+
+	static Matrix4 identity();
+	static Matrix4 perspective(const float verticalAngle, const float aspectRatio, const float nearPlane, const float farPlane);
+	static Matrix4 multiply(const Matrix4& a, const Matrix4& b);
+
+	const Matrix4& viewProjectionMatrix() const { return _viewProjectionMatrix; };
+
+	//Points per culling chunk, chunks are tested in parallel
+	static constexpr size_t CHUNK_SIZE = 1 << 16;
+
+	bool isPointVisible(const float x, const float y, const float z) const;
+
+	//Appends the visible points to outVisible, keeping their order. Returns the number of appended points
+	size_t cull(const float* x, const float* y, const float* z, const size_t count, StarShell& outVisible) const;
+	//Anchored points keep their anchors, anchors without visible points are dropped
+	size_t cull(const StarShellView& points, StarShell& outVisible) const;
+
+	//Whether a sphere is entirely outside, partially inside or entirely inside the frustum
+	FrustumIntersection classifySphere(const double x, const double y, const double z, const double radius) const;
+
+	//Smallest cone around the view axis containing the frustum, the full sphere if the frustum apex isn't the origin
+	DirectionCone boundingCone() const;
+
+private:
+	void extractPlanes();
+	//Planes in the frame of an anchor, a*x + b*y + c*z + d of an offset equals that of the anchored point
+	void anchorPlanes(const StarAnchor& anchor, float outPlanes[6][4]) const;
+
+	Matrix4 _viewProjectionMatrix;
+
+	//Left, right, bottom, top, near, far as (a, b, c, d), a point is inside when a*x + b*y + c*z + d > 0 for all of them
+	float _planes[6][4];
+	float _planeNormalLengths[6];
+};
@@ -0,0 +1,275 @@
+#include "HalleyGenerator.h"
+
+#include <random>
+#include <cmath>
+#include <algorithm>
+#include <array>
+
+#include "Global.h"
+#include "Photometry.h"
+#include "FluxAccumulator.h"
+#include "FluxKernel.h"
+#include "Parallel.h"
+#include "Trace.h"
+
+namespace
+{
+	//Orthonormal u, v and the cone axis w
+	using ConeBasis = std::array<std::array<float, 3>, 3>;
+
+	//Range of stars to draw within a shell's part of the cone
+	struct SampleBounds
+	{
+		double radiusCubed[2];
+		float cosAngle[2];
+		float theta[2];
+	};
+
+	ConeBasis coneBasis(const DirectionCone& cone)
+	{
+		const std::array<float, 3>& w = cone.axis;
+		const std::array<float, 3> helper = std::abs(w[0]) < 0.9f ? std::array<float, 3>{1.f, 0.f, 0.f} : std::array<float, 3>{0.f, 1.f, 0.f};
+		std::array<float, 3> u{w[1] * helper[2] - w[2] * helper[1], w[2] * helper[0] - w[0] * helper[2], w[0] * helper[1] - w[1] * helper[0]};
+		const float uLength = sqrt(u[0] * u[0] + u[1] * u[1] + u[2] * u[2]);
+		for (float& component : u) component /= uLength;
+		const std::array<float, 3> v{w[1] * u[2] - w[2] * u[1], w[2] * u[0] - w[0] * u[2], w[0] * u[1] - w[1] * u[0]};
+		return {u, v, w};
+	}
+
+	//Volume-uniform radius (r^3 uniform) and solid angle uniform direction
+	void appendCandidates(RandomStream& random, const ConeBasis& basis, const SampleBounds& bounds, const size_t count, StarShell& outCandidates)
+	{
+		const std::array<float, 3>& u = basis[0];
+		const std::array<float, 3>& v = basis[1];
+		const std::array<float, 3>& w = basis[2];
+		for (size_t star = 0; star < count; star++)
+		{
+			const float radius = cbrt(random.uniform(bounds.radiusCubed[0], bounds.radiusCubed[1]));
+			const float cosAngle = random.uniform(bounds.cosAngle[0], bounds.cosAngle[1]);
+			const float theta = random.uniform(bounds.theta[0], bounds.theta[1]);
+
+			const float sinAngle = sqrt(std::max(1.f - cosAngle * cosAngle, 0.f));
+			const float a = sinAngle * cos(theta);
+			const float b = sinAngle * sin(theta);
+
+			const float x = (a * u[0] + b * v[0] + cosAngle * w[0]) * radius;
+			const float y = (a * u[1] + b * v[1] + cosAngle * w[1]) * radius;
+			const float z = (a * u[2] + b * v[2] + cosAngle * w[2]) * radius;
+			outCandidates.append(x, y, z);
+		}
+	}
+}
+
+HalleyGenerator::HalleyGenerator(int shellCount, float shellThickness, float firstShellDistance, uint64_t seed, float tolerance, int sampleCount)
+{
+	_seed = seed;
+	_shellCount = shellCount;
+	_shellThickness = shellThickness;
+	_firstShellDistance = firstShellDistance;
+	_tolerance = tolerance;
+	_sampleCount = sampleCount;
+}
+
+double HalleyGenerator::shellVolume(int shellIndex, float shellThickness, float firstShellDistance)
+{
+	const float innerRadius = firstShellDistance + shellIndex * shellThickness;
+	const float outerRadius = firstShellDistance + (shellIndex + 1) * shellThickness;
+	return (4.f / 3.f) * M_PI * (pow(outerRadius, 3) - pow(innerRadius, 3));
+}
+
+void HalleyGenerator::generate(const Frustum& frustum, ShellSink& outShells, const int firstShell, const CancellationToken& cancellation)
+{
+	if (_tolerance > 0.f)
+	{
+		generateAdaptive(frustum, outShells, firstShell, cancellation);
+		return;
+	}
+
+	//Stars are only sampled in a cone around the frustum, the few outside of it are culled
+	const DirectionCone cone = frustum.boundingCone();
+	const ConeBasis basis = coneBasis(cone);
+
+	//Number of each shell's stars falling inside the cone, split into fixed size chunks
+	struct Chunk
+	{
+		int shellIndex;
+		uint32_t chunkIndex;
+		size_t starCount;
+	};
+	std::vector<Chunk> chunks;
+	for (int n = firstShell; n < _shellCount; n++)
+	{
+		const long long shellStarCount = floor(shellVolume(n, _shellThickness, _firstShellDistance) / STELLAR_DENSITY);
+		RandomStream countRandom(_seed, n, COUNT_SUBSTREAM);
+		std::binomial_distribution<long long> countDist(shellStarCount, std::min(cone.solidAngleFraction(), 1.));
+		const size_t starCount = countDist(countRandom);
+
+		for (size_t begin = 0; begin < starCount; begin += Frustum::CHUNK_SIZE)
+		{
+			chunks.push_back({n, uint32_t(begin / Frustum::CHUNK_SIZE), std::min(Frustum::CHUNK_SIZE, starCount - begin)});
+		}
+	}
+
+	//Shells are generated in batches of consecutive shells with enough chunks for every thread, and handed out in order
+	const size_t batchChunkCount = 4 * size_t(Parallel::threadCount());
+	int emittedShellCount = firstShell;
+	for (size_t batchBegin = 0; emittedShellCount < _shellCount;)
+	{
+		size_t batchEnd = std::min(batchBegin + batchChunkCount, chunks.size());
+		while (batchEnd < chunks.size() && chunks[batchEnd].shellIndex == chunks[batchEnd - 1].shellIndex) batchEnd++;
+
+		//Every chunk has its own random stream, so the catalog only depends on the seed
+		std::vector<StarShell> visibleChunks(batchEnd - batchBegin);
+		Parallel::forEach(visibleChunks.size(), [&](size_t batchIndex)
+		{
+			if (cancellation.isCancelled()) return;
+			OLBERS_TRACE_SCOPE("halley chunk", "generation");
+			const Chunk& chunk = chunks[batchBegin + batchIndex];
+			RandomStream random(_seed, chunk.shellIndex, chunk.chunkIndex);
+
+			const double innerRadius = _firstShellDistance + chunk.shellIndex * _shellThickness;
+			const double outerRadius = _firstShellDistance + (chunk.shellIndex + 1) * _shellThickness;
+			const SampleBounds bounds = {{pow(innerRadius, 3), pow(outerRadius, 3)}, {cone.cosHalfAngle, 1.f}, {0.f, float(2 * M_PI)}};
+
+			StarShell candidates;
+			candidates.reserve(chunk.starCount);
+			appendCandidates(random, basis, bounds, chunk.starCount, candidates);
+
+			//Occlusion culling
+			frustum.cull(candidates, visibleChunks[batchIndex]);
+		});
+
+		if (cancellation.isCancelled()) return;
+
+		//Hand out the batch's shells, including the empty ones before the next batch
+		const int lastShell = batchEnd < chunks.size() ? chunks[batchEnd].shellIndex : _shellCount;
+		size_t chunkIndex = batchBegin;
+		for (; emittedShellCount < lastShell; emittedShellCount++)
+		{
+			StarShell shell;
+			for (; chunkIndex < batchEnd && chunks[chunkIndex].shellIndex == emittedShellCount; chunkIndex++)
+			{
+				StarShell& visible = visibleChunks[chunkIndex - batchBegin];
+				shell.x.insert(shell.x.end(), visible.x.begin(), visible.x.end());
+				shell.y.insert(shell.y.end(), visible.y.begin(), visible.y.end());
+				shell.z.insert(shell.z.end(), visible.z.begin(), visible.z.end());
+				visible = StarShell();
+			}
+			outShells.addShell(std::move(shell));
+		}
+		batchBegin = batchEnd;
+	}
+}
+
+void HalleyGenerator::generateAdaptive(const Frustum& frustum, ShellSink& outShells, const int firstShell, const CancellationToken& cancellation)
+{
+	const DirectionCone cone = frustum.boundingCone();
+	const ConeBasis basis = coneBasis(cone);
+	const size_t stratumSampleCount = std::max<size_t>(MIN_STRATUM_SAMPLE_COUNT, (size_t(std::max(_sampleCount, 0)) + STRATUM_COUNT - 1) / STRATUM_COUNT);
+	const size_t sampleCount = stratumSampleCount * STRATUM_COUNT;
+	const double fluxAtOneParsec = FluxKernel::fluxAtOneParsec();
+
+	struct ShellSample
+	{
+		StarShell shell;
+		double flux = 0.;
+	};
+
+	//Shells are independent, batches of them are generated in parallel and handed out in order until settled
+	const int batchShellCount = 4 * Parallel::threadCount();
+	CompensatedSum cumulativeFlux;
+	int settledShellCount = 0;
+	for (int batchBegin = firstShell; batchBegin < _shellCount; batchBegin += batchShellCount)
+	{
+		std::vector<ShellSample> samples(std::min(batchShellCount, _shellCount - batchBegin));
+		Parallel::forEach(samples.size(), [&](size_t batchIndex)
+		{
+			if (cancellation.isCancelled()) return;
+			OLBERS_TRACE_SCOPE("halley shell sample", "generation");
+			const int n = batchBegin + int(batchIndex);
+			ShellSample& sample = samples[batchIndex];
+
+			//Same count as a full run
+			const long long shellStarCount = floor(shellVolume(n, _shellThickness, _firstShellDistance) / STELLAR_DENSITY);
+			RandomStream countRandom(_seed, n, COUNT_SUBSTREAM);
+			std::binomial_distribution<long long> countDist(shellStarCount, std::min(cone.solidAngleFraction(), 1.));
+			const size_t starCount = countDist(countRandom);
+
+			const double innerRadiusCubed = pow(_firstShellDistance + n * _shellThickness, 3);
+			const double outerRadiusCubed = pow(_firstShellDistance + (n + 1) * _shellThickness, 3);
+			StarShell candidates;
+
+			//Small shells are generated whole, with the same stars as a full run. Their variance is that of a Poisson sum of the fluxes
+			if (starCount <= sampleCount)
+			{
+				for (size_t begin = 0; begin < starCount; begin += Frustum::CHUNK_SIZE)
+				{
+					RandomStream random(_seed, n, uint32_t(begin / Frustum::CHUNK_SIZE));
+					candidates.clear();
+					appendCandidates(random, basis, {{innerRadiusCubed, outerRadiusCubed}, {cone.cosHalfAngle, 1.f}, {0.f, float(2 * M_PI)}}, std::min(Frustum::CHUNK_SIZE, starCount - begin), candidates);
+					frustum.cull(candidates, sample.shell);
+				}
+				for (size_t i = 0; i < sample.shell.size(); i++)
+				{
+					const double flux = fluxAtOneParsec / (sample.shell.distance(i) * sample.shell.distance(i));
+					sample.flux += flux;
+					sample.shell.fluxVariance += flux * flux;
+				}
+				return;
+			}
+
+			//Every stratum holds the same share of the stars, so every sampled star stands for the same number of stars
+			RandomStream random(_seed, n, SAMPLE_SUBSTREAM);
+			const double stratumStarCount = double(starCount) / STRATUM_COUNT;
+			sample.shell.weight = double(starCount) / sampleCount;
+			for (int radial = 0; radial < RADIAL_STRATA; radial++)
+			{
+				for (int polar = 0; polar < POLAR_STRATA; polar++)
+				{
+					for (int azimuth = 0; azimuth < AZIMUTH_STRATA; azimuth++)
+					{
+						SampleBounds bounds;
+						for (int side = 0; side < 2; side++)
+						{
+							bounds.radiusCubed[side] = innerRadiusCubed + (outerRadiusCubed - innerRadiusCubed) * (radial + side) / RADIAL_STRATA;
+							bounds.cosAngle[side] = cone.cosHalfAngle + (1.f - cone.cosHalfAngle) * (polar + side) / POLAR_STRATA;
+							bounds.theta[side] = float(2 * M_PI) * (azimuth + side) / AZIMUTH_STRATA;
+						}
+						candidates.clear();
+						appendCandidates(random, basis, bounds, stratumSampleCount, candidates);
+						const size_t first = sample.shell.size();
+						frustum.cull(candidates, sample.shell);
+
+						//Culled candidates count as zero flux
+						double sum = 0.;
+						double sumSquared = 0.;
+						for (size_t i = first; i < sample.shell.size(); i++)
+						{
+							const double flux = fluxAtOneParsec / (sample.shell.distance(i) * sample.shell.distance(i));
+							sum += flux;
+							sumSquared += flux * flux;
+						}
+						const double stratumVariance = std::max(sumSquared - sum * sum / stratumSampleCount, 0.) / (stratumSampleCount - 1);
+						sample.flux += sum * sample.shell.weight;
+						sample.shell.fluxVariance += stratumStarCount * stratumStarCount * stratumVariance / stratumSampleCount;
+					}
+				}
+			}
+		});
+
+		if (cancellation.isCancelled()) return;
+
+		for (ShellSample& sample : samples)
+		{
+			//Upper confidence bound of the shell's sky brightness increment
+			const double previousFlux = cumulativeFlux.value();
+			const double upperShellFlux = sample.flux + Photometry::CONFIDENCE_Z * std::sqrt(sample.shell.fluxVariance);
+			cumulativeFlux.add(sample.flux);
+			if (previousFlux > 0. && 2.5 * std::log10((previousFlux + upperShellFlux) / previousFlux) < _tolerance) settledShellCount++;
+			else settledShellCount = 0;
+
+			outShells.addShell(std::move(sample.shell));
+			if (settledShellCount >= SETTLED_SHELL_COUNT) return;
+		}
+	}
+}
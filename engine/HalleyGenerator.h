@@ -0,0 +1,44 @@
+#pragma once
+
+#include <cstdint>
+
+#include "StarGenerator.h"
+#include "Random.h"
+
+class HalleyGenerator : public StarGenerator
+{
+public:
+	//A tolerance above 0 samples large shells and stops once the sky brightness has settled, see generateAdaptive()
+	HalleyGenerator(int shellCount, float shellThickness, float firstShellDistance, uint64_t seed, float tolerance = 0.f, int sampleCount = 0);
+
+	virtual void generate(const Frustum& frustum, ShellSink& outShells, const int firstShell, const CancellationToken& cancellation) override;
+
+	static double shellVolume(int shellIndex, float shellThickness, float firstShellDistance);
+
+	//Adaptive sampling splits a shell into strata of equal expected star count, in radius, polar angle and azimuth
+	static constexpr int RADIAL_STRATA = 4;
+	static constexpr int POLAR_STRATA = 4;
+	static constexpr int AZIMUTH_STRATA = 4;
+	static constexpr int STRATUM_COUNT = RADIAL_STRATA * POLAR_STRATA * AZIMUTH_STRATA;
+	//Fewer samples per stratum give unreliable variance estimates
+	static constexpr int MIN_STRATUM_SAMPLE_COUNT = 16;
+	//Consecutive shells below the tolerance before the sky brightness counts as settled
+	static constexpr int SETTLED_SHELL_COUNT = 3;
+
+private:
+	//Substream of each shell's random stream used for the visible star count, chunks use 0, 1, 2...
+	static constexpr uint32_t COUNT_SUBSTREAM = UINT32_MAX;
+	//Substream of the stratified sample of a shell
+	static constexpr uint32_t SAMPLE_SUBSTREAM = UINT32_MAX - 1;
+
+	int _shellCount;
+	float _shellThickness;
+	float _firstShellDistance;
+	uint64_t _seed;
+	float _tolerance;
+	int _sampleCount;
+
+	//Shells with more stars in the cone than the sample count are estimated from a stratified sample. Stops after the
+	//upper confidence bound of the sky brightness increment stayed below the tolerance for SETTLED_SHELL_COUNT shells
+	void generateAdaptive(const Frustum& frustum, ShellSink& outShells, const int firstShell, const CancellationToken& cancellation);
+};
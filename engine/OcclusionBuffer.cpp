@@ -0,0 +1,256 @@
+#include "OcclusionBuffer.h"
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+
+#include "Global.h"
+#include "Photometry.h"
+#include "SkyMap.h"
+#include "Parallel.h"
+#include "Trace.h"
+
+void OcclusionBuffer::reset(const int width, const int height, const Frustum& frustum)
+{
+	_width = std::max(width, 0);
+	_height = std::max(height, 0);
+	_viewProjectionMatrix = frustum.viewProjectionMatrix();
+	_tanHalfHeight = std::tan(CAMERA_VFOV * M_PI / 360.);
+	_tanHalfWidth = CAMERA_ASPECT_RATIO * _tanHalfHeight;
+
+	const size_t pixelCount = size_t(_width) * _height;
+	_depth.assign(pixelCount, std::numeric_limits<float>::infinity());
+	_coveredSolidAngle.clear();
+	_disks.clear();
+	_tileStars.clear();
+
+	//Pixels are even steps on the tangent plane, same grid as the sky map
+	_directionX.resize(pixelCount);
+	_directionY.resize(pixelCount);
+	_directionZ.resize(pixelCount);
+	_pixelSolidAngle.resize(pixelCount);
+	_solidAngle = 0.;
+	for (int y = 0; y < _height; y++)
+	{
+		const double y0 = _tanHalfHeight * (2. * y / _height - 1.);
+		const double y1 = _tanHalfHeight * (2. * (y + 1) / _height - 1.);
+		for (int x = 0; x < _width; x++)
+		{
+			const double x0 = _tanHalfWidth * (2. * x / _width - 1.);
+			const double x1 = _tanHalfWidth * (2. * (x + 1) / _width - 1.);
+			const double centerX = 0.5 * (x0 + x1);
+			const double centerY = 0.5 * (y0 + y1);
+			const double length = std::sqrt(1. + centerX * centerX + centerY * centerY);
+
+			const size_t pixel = size_t(y) * _width + x;
+			_directionX[pixel] = float(centerX / length);
+			_directionY[pixel] = float(centerY / length);
+			_directionZ[pixel] = float(1. / length);
+			_pixelSolidAngle[pixel] = SkyMap::tangentRectangleSolidAngle(x0, y0, x1, y1);
+			_solidAngle += _pixelSolidAngle[pixel];
+		}
+	}
+
+	_tiles.clear();
+	_tileColumns = (_width + TILE_SIZE - 1) / TILE_SIZE;
+	const int tileRows = (_height + TILE_SIZE - 1) / TILE_SIZE;
+	for (int row = 0; row < tileRows; row++)
+	{
+		for (int column = 0; column < _tileColumns; column++)
+		{
+			Tile tile;
+			tile.x0 = column * TILE_SIZE;
+			tile.y0 = row * TILE_SIZE;
+			tile.x1 = std::min(tile.x0 + TILE_SIZE, _width) - 1;
+			tile.y1 = std::min(tile.y0 + TILE_SIZE, _height) - 1;
+			tile.uncoveredCount = (tile.x1 - tile.x0 + 1) * (tile.y1 - tile.y0 + 1);
+			tile.maxDepth = std::numeric_limits<float>::infinity();
+			tile.coveredSolidAngle = 0.;
+			_tiles.push_back(tile);
+		}
+	}
+}
+
+double OcclusionBuffer::occludedFlux(const int shellIndex) const
+{
+	//A sphere at distance d has the flux of its disk, pi * (R / d)^2 sr at a surface brightness independent of d
+	const double surfaceFlux = Photometry::apparentFlux(1.) / (M_PI * double(STELLAR_RADIUS) * STELLAR_RADIUS); //per sr
+	return surfaceFlux * _coveredSolidAngle[shellIndex];
+}
+
+bool OcclusionBuffer::projectDisk(const double x, const double y, const double z, Disk& disk) const
+{
+	//In double, far disks are narrower than the float spacing of their position
+	const Matrix4& m = _viewProjectionMatrix;
+	const double clipW = m[3] * x + m[7] * y + m[11] * z + m[15];
+	if (clipW <= 0.) return false;
+
+	//Tangent plane coordinates of the center, the lens is symmetric
+	const double tangentX = (m[0] * x + m[4] * y + m[8] * z + m[12]) / clipW * _tanHalfWidth;
+	const double tangentY = (m[1] * x + m[5] * y + m[9] * z + m[13]) / clipW * _tanHalfHeight;
+	const double tangentLength = std::sqrt(tangentX * tangentX + tangentY * tangentY);
+	const double length = std::sqrt(1. + tangentLength * tangentLength);
+	disk.directionX = float(tangentX / length);
+	disk.directionY = float(tangentY / length);
+	disk.directionZ = float(1. / length);
+
+	const double distance = std::sqrt(x * x + y * y + z * z);
+	disk.depth = float(distance);
+	disk.x0 = 0;
+	disk.y0 = 0;
+	disk.x1 = _width - 1;
+	disk.y1 = _height - 1;
+
+	//Inside the star the whole sky is covered
+	if (distance <= STELLAR_RADIUS)
+	{
+		disk.chordSquared = 4.f;
+		return true;
+	}
+
+	//Squared chord between the center and the edge of the disk on the unit sphere, 2 * (1 - cos(a)) without cancellation
+	const double sinRadius = STELLAR_RADIUS / distance;
+	const double cosRadius = std::sqrt(1. - sinRadius * sinRadius);
+	disk.chordSquared = float(2. * sinRadius * sinRadius / (1. + cosRadius));
+
+	//The disk reaches farthest on the tangent plane in the radial direction
+	const double centerAngle = std::atan(tangentLength);
+	const double edgeAngle = centerAngle + std::asin(sinRadius);
+	if (edgeAngle >= 0.5 * M_PI) return true;
+	const double extent = std::tan(edgeAngle) - tangentLength;
+
+	auto column = [&](const double tangent) { return (tangent / _tanHalfWidth + 1.) * 0.5 * _width - 0.5; };
+	auto row = [&](const double tangent) { return (tangent / _tanHalfHeight + 1.) * 0.5 * _height - 0.5; };
+	disk.x0 = int(std::max(std::floor(column(tangentX - extent)), 0.));
+	disk.x1 = int(std::min(std::ceil(column(tangentX + extent)), _width - 1.));
+	disk.y0 = int(std::max(std::floor(row(tangentY - extent)), 0.));
+	disk.y1 = int(std::min(std::ceil(row(tangentY + extent)), _height - 1.));
+	return disk.x0 <= disk.x1 && disk.y0 <= disk.y1;
+}
+
+void OcclusionBuffer::addShell(const StarShellView& shell)
+{
+	if (!isEnabled()) return;
+	OLBERS_TRACE_SCOPE("occlusion", "brightness");
+
+	const size_t tileCount = _tiles.size();
+	const size_t chunkCount = std::max<size_t>(1, std::min(size_t(Parallel::threadCount()), shell.size() / MIN_CHUNK_STARS));
+	const size_t chunkSize = (shell.size() + chunkCount - 1) / chunkCount;
+	_disks.resize(shell.size());
+	_chunkTileCounts.resize(std::max(_chunkTileCounts.size(), chunkCount));
+
+	auto forEachTile = [&](const Disk& disk, auto&& fn)
+	{
+		for (int row = disk.y0 / TILE_SIZE; row <= disk.y1 / TILE_SIZE; row++)
+		{
+			for (int column = disk.x0 / TILE_SIZE; column <= disk.x1 / TILE_SIZE; column++) fn(size_t(row) * _tileColumns + column);
+		}
+	};
+
+	//Project the disks and count them per tile
+	Parallel::forEach(chunkCount, [&](const size_t chunk)
+	{
+		std::vector<uint32_t>& counts = _chunkTileCounts[chunk];
+		counts.assign(tileCount, 0);
+		const size_t end = std::min(shell.size(), (chunk + 1) * chunkSize);
+		shell.forEachSegment(chunk * chunkSize, end, [&](const StarAnchor& anchor, const size_t first, const size_t last)
+		{
+			for (size_t i = first; i < last; i++)
+			{
+				Disk& disk = _disks[i];
+				if (!projectDisk(anchor.x + shell.x[i], anchor.y + shell.y[i], anchor.z + shell.z[i], disk))
+				{
+					disk.x0 = 1;
+					disk.x1 = 0;
+					continue;
+				}
+				forEachTile(disk, [&](const size_t tile) { counts[tile]++; });
+			}
+		});
+	});
+
+	//Counts become write positions, tiles keep the star order of the shell
+	std::vector<size_t> tileBegin(tileCount + 1, 0);
+	std::vector<std::vector<size_t>> positions(chunkCount, std::vector<size_t>(tileCount));
+	size_t position = 0;
+	for (size_t tile = 0; tile < tileCount; tile++)
+	{
+		tileBegin[tile] = position;
+		for (size_t chunk = 0; chunk < chunkCount; chunk++)
+		{
+			positions[chunk][tile] = position;
+			position += _chunkTileCounts[chunk][tile];
+		}
+	}
+	tileBegin[tileCount] = position;
+	_tileStars.resize(position);
+
+	Parallel::forEach(chunkCount, [&](const size_t chunk)
+	{
+		std::vector<size_t>& next = positions[chunk];
+		const size_t end = std::min(shell.size(), (chunk + 1) * chunkSize);
+		for (size_t i = chunk * chunkSize; i < end; i++)
+		{
+			const Disk& disk = _disks[i];
+			if (disk.x0 > disk.x1) continue;
+			forEachTile(disk, [&](const size_t tile) { _tileStars[next[tile]++] = uint32_t(i); });
+		}
+	});
+
+	Parallel::forEach(tileCount, [&](const size_t tile)
+	{
+		rasterizeTile(_tiles[tile], _tileStars.data() + tileBegin[tile], tileBegin[tile + 1] - tileBegin[tile]);
+	});
+
+	double coveredSolidAngle = 0.;
+	for (const Tile& tile : _tiles) coveredSolidAngle += tile.coveredSolidAngle;
+	_coveredSolidAngle.push_back(coveredSolidAngle);
+}
+
+void OcclusionBuffer::rasterizeTile(Tile& tile, uint32_t* stars, const size_t count)
+{
+	//Nearest first, a covered tile then rejects the rest of the shell without touching its pixels
+	std::sort(stars, stars + count, [&](const uint32_t a, const uint32_t b)
+	{
+		return _disks[a].depth < _disks[b].depth || (_disks[a].depth == _disks[b].depth && a < b);
+	});
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const Disk& disk = _disks[stars[i]];
+		if (tile.uncoveredCount == 0 && disk.depth >= tile.maxDepth) break;
+
+		const int x0 = std::max(disk.x0, tile.x0);
+		const int x1 = std::min(disk.x1, tile.x1);
+		const int y0 = std::max(disk.y0, tile.y0);
+		const int y1 = std::min(disk.y1, tile.y1);
+		for (int y = y0; y <= y1; y++)
+		{
+			for (size_t pixel = size_t(y) * _width + x0; pixel <= size_t(y) * _width + x1; pixel++)
+			{
+				if (_depth[pixel] <= disk.depth) continue;
+
+				const float dx = _directionX[pixel] - disk.directionX;
+				const float dy = _directionY[pixel] - disk.directionY;
+				const float dz = _directionZ[pixel] - disk.directionZ;
+				if (dx * dx + dy * dy + dz * dz > disk.chordSquared) continue;
+
+				if (_depth[pixel] == std::numeric_limits<float>::infinity())
+				{
+					tile.uncoveredCount--;
+					tile.coveredSolidAngle += _pixelSolidAngle[pixel];
+				}
+				_depth[pixel] = disk.depth;
+			}
+		}
+
+		if (tile.uncoveredCount == 0 && tile.maxDepth == std::numeric_limits<float>::infinity())
+		{
+			tile.maxDepth = 0.f;
+			for (int y = tile.y0; y <= tile.y1; y++)
+			{
+				for (int x = tile.x0; x <= tile.x1; x++) tile.maxDepth = std::max(tile.maxDepth, _depth[size_t(y) * _width + x]);
+			}
+		}
+	}
+}
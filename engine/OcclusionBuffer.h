@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "Frustum.h"
+
+//Angular depth buffer over the camera FOV, every pixel keeps the distance of the nearest star disk covering its center
+class OcclusionBuffer
+{
+public:
+	//Starts an empty buffer, pixel directions assume the default camera lens
+	void reset(const int width, const int height, const Frustum& frustum);
+	bool isEnabled() const { return _width > 0; };
+
+	//Rasterizes the star disks of a culled shell, only pixels of earlier shells' stars are kept
+	void addShell(const StarShellView& shell);
+
+	int width() const { return _width; };
+	int height() const { return _height; };
+	int shellCount() const { return int(_coveredSolidAngle.size()); };
+
+	//Fraction of the FOV hidden behind star disks after a shell
+	double coveredFraction(const int shellIndex) const { return _coveredSolidAngle[shellIndex] / _solidAngle; };
+	//Flux of the visible star surface after a shell, every star has the surface brightness of the sun
+	double occludedFlux(const int shellIndex) const;
+
+	//Distance of the nearest star per pixel, rows from the bottom, infinity where the sky is empty
+	const std::vector<float>& depth() const { return _depth; };
+
+private:
+	//Square screen tiles, a tile is rasterized by a single task
+	static constexpr int TILE_SIZE = 32;
+	//Stars per binning task, smaller shells aren't split
+	static constexpr size_t MIN_CHUNK_STARS = 1 << 14;
+
+	//Star disk, direction in camera space and inclusive pixel bounds
+	struct Disk
+	{
+		float directionX;
+		float directionY;
+		float directionZ;
+		//Squared distance of the edge from the center on the unit sphere
+		float chordSquared;
+		float depth;
+		int x0;
+		int y0;
+		int x1;
+		int y1;
+	};
+
+	struct Tile
+	{
+		int x0;
+		int y0;
+		int x1;
+		int y1;
+		int uncoveredCount;
+		//Upper bound of the pixel depths once the tile is covered, nothing farther can show
+		float maxDepth;
+		double coveredSolidAngle;
+	};
+
+	int _width = 0;
+	int _height = 0;
+	int _tileColumns = 0;
+	Matrix4 _viewProjectionMatrix{};
+	double _tanHalfWidth = 0.;
+	double _tanHalfHeight = 0.;
+	double _solidAngle = 0.; //sr
+
+	//Unit direction of every pixel center in camera space, looking down +z
+	std::vector<float> _directionX;
+	std::vector<float> _directionY;
+	std::vector<float> _directionZ;
+	std::vector<double> _pixelSolidAngle; //sr
+	std::vector<float> _depth;
+	std::vector<Tile> _tiles;
+
+	std::vector<Disk> _disks;
+	std::vector<uint32_t> _tileStars;
+	std::vector<std::vector<uint32_t>> _chunkTileCounts;
+
+	std::vector<double> _coveredSolidAngle;
+
+	bool projectDisk(const double x, const double y, const double z, Disk& disk) const;
+	void rasterizeTile(Tile& tile, uint32_t* stars, const size_t count);
+};
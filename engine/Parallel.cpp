@@ -0,0 +1,42 @@
+#include "Parallel.h"
+
+#include <thread>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+
+#include "TaskScheduler.h"
+
+static std::atomic<int> requestedThreadCount{0};
+
+int Parallel::threadCount()
+{
+	const int requested = requestedThreadCount;
+	if (requested > 0) return requested;
+	return std::max(1u, std::thread::hardware_concurrency());
+}
+
+void Parallel::setThreadCount(const int count)
+{
+	requestedThreadCount = std::max(count, 0);
+}
+
+void Parallel::forEach(const size_t taskCount, const std::function<void(size_t)>& task)
+{
+	if (taskCount == 0) return;
+
+	std::atomic<size_t> nextTask{0};
+	auto worker = [&]
+	{
+		for (size_t index = nextTask++; index < taskCount; index = nextTask++) task(index);
+	};
+
+	//The calling thread takes part, the helpers run on the persistent pool
+	TaskScheduler& scheduler = TaskScheduler::instance();
+	const size_t helperCount = std::min(size_t(threadCount()), taskCount) - 1;
+	std::vector<TaskHandle> helpers;
+	helpers.reserve(helperCount);
+	for (size_t i = 0; i < helperCount; i++) helpers.push_back(scheduler.submit(worker));
+	worker();
+	for (const TaskHandle& helper : helpers) scheduler.wait(helper);
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <functional>
+#include <cstddef>
+
+namespace Parallel
+{
+	//Number of worker threads used by the engine, 0 = hardware concurrency
+	int threadCount();
+	void setThreadCount(const int count);
+
+	//Runs task(0..taskCount-1) on the calling thread and up to threadCount() - 1 pool workers, returns when all are done
+	void forEach(const size_t taskCount, const std::function<void(size_t)>& task);
+}
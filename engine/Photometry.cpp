@@ -0,0 +1,25 @@
+#include "Photometry.h"
+
+#include <cmath>
+
+double Photometry::apparentFlux(const double distance)
+{
+	const double apvmag = ABSOLUTE_VISUAL_MAGNITUDE + 5. * std::log10(distance / 10.);
+	return std::pow(10., -0.4 * apvmag);
+}
+
+Brightness Photometry::fromFlux(const double fluxSum)
+{
+	Brightness brightness;
+	brightness.totalApvmag = -2.5 * std::log10(fluxSum);
+	brightness.surfaceBrightness = brightness.totalApvmag + 2.5 * std::log10(CAMERA_ANGULAR_AREA_SQ_ARCSEC);
+	brightness.linearSurfaceBrightness = std::pow(M_E, -brightness.surfaceBrightness);
+	return brightness;
+}
+
+double Photometry::surfaceBrightnessError(const double fluxSum, const double fluxVariance)
+{
+	//First order, d(mag) = 2.5 / ln(10) * dF / F
+	if (fluxSum <= 0.) return 0.;
+	return 2.5 / std::log(10.) * CONFIDENCE_Z * std::sqrt(fluxVariance) / fluxSum;
+}
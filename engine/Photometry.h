@@ -0,0 +1,25 @@
+#pragma once
+
+#include "Global.h"
+
+struct Brightness
+{
+	double totalApvmag = 0.;
+	double surfaceBrightness = 0.;
+	double linearSurfaceBrightness = 0.;
+};
+
+namespace Photometry
+{
+	//Two-sided 95% quantile of the normal distribution
+	constexpr double CONFIDENCE_Z = 1.959964;
+
+	//Apparent flux (in units of 10^(-0.4 * apvmag)) of a sun-like star at the given distance in pc
+	double apparentFlux(const double distance);
+
+	//Total apparent magnitude and sky surface brightness over the camera FOV for a summed flux
+	Brightness fromFlux(const double fluxSum);
+
+	//Half-width of the 95% confidence interval of the surface brightness in mag*arcsec^-2, from the variance of the flux estimate
+	double surfaceBrightnessError(const double fluxSum, const double fluxVariance);
+}
@@ -0,0 +1,58 @@
+#include "Random.h"
+
+#include <random>
+
+static constexpr uint32_t PHILOX_M0 = 0xD2511F53;
+static constexpr uint32_t PHILOX_M1 = 0xCD9E8D57;
+static constexpr uint32_t PHILOX_W0 = 0x9E3779B9;
+static constexpr uint32_t PHILOX_W1 = 0xBB67AE85;
+
+Philox::Counter Philox::generate(Counter counter, Key key)
+{
+	for (int round = 0; round < 10; round++)
+	{
+		const uint64_t product0 = uint64_t(PHILOX_M0) * counter[0];
+		const uint64_t product1 = uint64_t(PHILOX_M1) * counter[2];
+		counter = {uint32_t(product1 >> 32) ^ counter[1] ^ key[0], uint32_t(product1), uint32_t(product0 >> 32) ^ counter[3] ^ key[1], uint32_t(product0)};
+		key[0] += PHILOX_W0;
+		key[1] += PHILOX_W1;
+	}
+	return counter;
+}
+
+RandomStream::RandomStream(const uint64_t seed, const uint32_t stream, const uint32_t substream)
+{
+	_key = {uint32_t(seed), uint32_t(seed >> 32)};
+
+	//Words 0-1 count the blocks within the stream
+	_counter = {0, 0, stream, substream};
+}
+
+RandomStream::result_type RandomStream::operator()()
+{
+	if (_blockIndex == 4)
+	{
+		_block = Philox::generate(_counter, _key);
+		_blockIndex = 0;
+		if (++_counter[0] == 0) _counter[1]++;
+	}
+	return _block[_blockIndex++];
+}
+
+float RandomStream::uniformFloat()
+{
+	return float((*this)() >> 8) * (1.f / 16777216.f);
+}
+
+double RandomStream::uniformDouble()
+{
+	const uint64_t high = (*this)() >> 5;
+	const uint64_t low = (*this)() >> 6;
+	return double((high << 26) | low) * (1. / 9007199254740992.);
+}
+
+uint64_t RandomStream::randomSeed()
+{
+	std::random_device randomDevice;
+	return (uint64_t(randomDevice()) << 32) | randomDevice();
+}
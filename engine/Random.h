@@ -0,0 +1,45 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+//Philox4x32-10 counter-based generator (Salmon et al. 2011). Every (counter, key) pair maps to 4 independent 32-bit words,
+//so any element of any stream can be computed without generating the ones before it
+namespace Philox
+{
+	using Counter = std::array<uint32_t, 4>;
+	using Key = std::array<uint32_t, 2>;
+
+	Counter generate(Counter counter, Key key);
+}
+
+//Random stream keyed by (seed, stream, substream), the same triple always yields the same sequence whatever thread runs it.
+//Satisfies UniformRandomBitGenerator so it can drive the std distributions
+class RandomStream
+{
+public:
+	using result_type = uint32_t;
+
+	RandomStream(const uint64_t seed, const uint32_t stream, const uint32_t substream);
+
+	static constexpr result_type min() { return 0; };
+	static constexpr result_type max() { return UINT32_MAX; };
+
+	result_type operator()();
+
+	//Uniform in [0, 1) with 24 (float) or 53 (double) random bits
+	float uniformFloat();
+	double uniformDouble();
+
+	float uniform(const float min, const float max) { return min + (max - min) * uniformFloat(); };
+	double uniform(const double min, const double max) { return min + (max - min) * uniformDouble(); };
+
+	//Non-deterministic seed for runs that don't specify one
+	static uint64_t randomSeed();
+
+private:
+	Philox::Key _key;
+	Philox::Counter _counter;
+	Philox::Counter _block;
+	int _blockIndex = 4;
+};
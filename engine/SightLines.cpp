@@ -0,0 +1,405 @@
+#include "SightLines.h"
+
+#include <cmath>
+#include <array>
+#include <limits>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+
+#include "Global.h"
+#include "Random.h"
+#include "Simd.h"
+#include "Parallel.h"
+#include "Trace.h"
+
+namespace
+{
+	//Sub-cells of a packet cell, one jittered ray each
+	constexpr int PACKET_COLUMNS = 4;
+	constexpr int PACKET_ROWS = SightLines::PACKET_SIZE / PACKET_COLUMNS;
+	static_assert(PACKET_COLUMNS * PACKET_ROWS == SightLines::PACKET_SIZE, "Packets must fill their sub-cell grid");
+
+	constexpr int MORTON_BITS = 10;
+
+	//Spreads the low 10 bits of v two bits apart
+	uint32_t expandBits(uint32_t v)
+	{
+		v = (v * 0x00010001u) & 0xFF0000FFu;
+		v = (v * 0x00000101u) & 0x0F00F00Fu;
+		v = (v * 0x00000011u) & 0xC30C30C3u;
+		v = (v * 0x00000005u) & 0x49249249u;
+		return v;
+	}
+}
+
+void SightLines::reset(const size_t rayCount, const uint64_t seed, const Frustum& frustum)
+{
+	_viewProjectionMatrix = frustum.viewProjectionMatrix();
+	_tanHalfHeight = std::tan(CAMERA_VFOV * M_PI / 360.);
+	_tanHalfWidth = CAMERA_ASPECT_RATIO * _tanHalfHeight;
+	_coveringFraction.clear();
+	_meanHitDistance.clear();
+	_packets.clear();
+	if (rayCount == 0) return;
+
+	//Roughly square cells on the tangent plane
+	const size_t cellCount = (rayCount + PACKET_SIZE - 1) / PACKET_SIZE;
+	const size_t columns = std::max<size_t>(1, size_t(std::lround(std::sqrt(cellCount * double(CAMERA_ASPECT_RATIO)))));
+	const size_t rows = (cellCount + columns - 1) / columns;
+	_packets.resize(columns * rows);
+
+	Parallel::forEach(rows, [&](const size_t row)
+	{
+		RandomStream random(seed, RANDOM_STREAM, uint32_t(row));
+		for (size_t column = 0; column < columns; column++)
+		{
+			RayPacket& packet = _packets[row * columns + column];
+			for (int lane = 0; lane < PACKET_SIZE; lane++)
+			{
+				const double u = (column + (lane % PACKET_COLUMNS + random.uniformDouble()) / PACKET_COLUMNS) / columns;
+				const double v = (row + (lane / PACKET_COLUMNS + random.uniformDouble()) / PACKET_ROWS) / rows;
+				const double tangentX = _tanHalfWidth * (2. * u - 1.);
+				const double tangentY = _tanHalfHeight * (2. * v - 1.);
+				const double length = std::sqrt(1. + tangentX * tangentX + tangentY * tangentY);
+				packet.directionX[lane] = float(tangentX / length);
+				packet.directionY[lane] = float(tangentY / length);
+				packet.directionZ[lane] = float(1. / length);
+				packet.hitDistance[lane] = std::numeric_limits<float>::infinity();
+			}
+		}
+	});
+
+	_totalWeight = 0.;
+	for (const RayPacket& packet : _packets)
+	{
+		for (int lane = 0; lane < PACKET_SIZE; lane++) _totalWeight += rayWeight(packet, lane);
+	}
+}
+
+void SightLines::addShell(const StarShellView& shell)
+{
+	if (!isEnabled()) return;
+	OLBERS_TRACE_SCOPE("sight lines", "brightness");
+
+	build(shell);
+	const size_t taskCount = (_packets.size() + PACKETS_PER_TASK - 1) / PACKETS_PER_TASK;
+	std::vector<double> hitWeightSums(taskCount, 0.);
+	std::vector<double> distanceSums(taskCount, 0.);
+	{
+		OLBERS_TRACE_SCOPE("trace", "brightness");
+		Parallel::forEach(taskCount, [&](const size_t task)
+		{
+			const size_t end = std::min(_packets.size(), (task + 1) * PACKETS_PER_TASK);
+			for (size_t i = task * PACKETS_PER_TASK; i < end; i++)
+			{
+				RayPacket& packet = _packets[i];
+				if (!_nodes.empty()) trace(packet);
+				for (int lane = 0; lane < PACKET_SIZE; lane++)
+				{
+					if (packet.hitDistance[lane] == std::numeric_limits<float>::infinity()) continue;
+					const double weight = rayWeight(packet, lane);
+					hitWeightSums[task] += weight;
+					distanceSums[task] += weight * packet.hitDistance[lane];
+				}
+			}
+		});
+	}
+
+	double hitWeight = 0.;
+	double distance = 0.;
+	for (size_t task = 0; task < taskCount; task++)
+	{
+		hitWeight += hitWeightSums[task];
+		distance += distanceSums[task];
+	}
+	_coveringFraction.push_back(hitWeight / _totalWeight);
+	_meanHitDistance.push_back(hitWeight > 0. ? distance / hitWeight : std::numeric_limits<double>::quiet_NaN());
+}
+
+void SightLines::build(const StarShellView& shell)
+{
+	OLBERS_TRACE_SCOPE("build hierarchy", "brightness");
+
+	//Leaf indices must leave room for LEAF_FLAG, far beyond any shell that fits in memory
+	const size_t count = std::min(shell.size(), size_t(LEAF_FLAG - 1));
+	_nodes.clear();
+	if (count == 0) return;
+
+	const size_t chunkCount = std::max<size_t>(1, std::min(size_t(Parallel::threadCount()), count / MIN_CHUNK_STARS));
+	auto chunkBegin = [&](const size_t chunk) { return chunk * count / chunkCount; };
+
+	//Camera space of a rigid view and a symmetric lens, clip x and y scaled back by the lens and w as the depth.
+	//Anchored stars are transformed in double, their float offsets alone would be relative to the anchor
+	const Matrix4& m = _viewProjectionMatrix;
+	const float scaleX = float(_tanHalfWidth);
+	const float scaleY = float(_tanHalfHeight);
+	auto toCamera = [&](const size_t i, float& outX, float& outY, float& outZ)
+	{
+		if (shell.anchorCount == 0)
+		{
+			const float x = shell.x[i];
+			const float y = shell.y[i];
+			const float z = shell.z[i];
+			outX = (m[0] * x + m[4] * y + m[8] * z + m[12]) * scaleX;
+			outY = (m[1] * x + m[5] * y + m[9] * z + m[13]) * scaleY;
+			outZ = m[3] * x + m[7] * y + m[11] * z + m[15];
+			return;
+		}
+
+		double x, y, z;
+		shell.position(i, x, y, z);
+		outX = float((m[0] * x + m[4] * y + m[8] * z + m[12]) * _tanHalfWidth);
+		outY = float((m[1] * x + m[5] * y + m[9] * z + m[13]) * _tanHalfHeight);
+		outZ = float(m[3] * x + m[7] * y + m[11] * z + m[15]);
+	};
+
+	//Morton codes of the centers within the shell bounds
+	std::vector<std::array<float, 6>> chunkBounds(chunkCount);
+	Parallel::forEach(chunkCount, [&](const size_t chunk)
+	{
+		std::array<float, 6> bounds = {INFINITY, INFINITY, INFINITY, -INFINITY, -INFINITY, -INFINITY};
+		for (size_t i = chunkBegin(chunk); i < chunkBegin(chunk + 1); i++)
+		{
+			float x, y, z;
+			toCamera(i, x, y, z);
+			bounds = {std::min(bounds[0], x), std::min(bounds[1], y), std::min(bounds[2], z), std::max(bounds[3], x), std::max(bounds[4], y), std::max(bounds[5], z)};
+		}
+		chunkBounds[chunk] = bounds;
+	});
+	std::array<float, 6> bounds = chunkBounds[0];
+	for (const std::array<float, 6>& chunk : chunkBounds)
+	{
+		for (int axis = 0; axis < 3; axis++)
+		{
+			bounds[axis] = std::min(bounds[axis], chunk[axis]);
+			bounds[axis + 3] = std::max(bounds[axis + 3], chunk[axis + 3]);
+		}
+	}
+
+	float scale[3];
+	for (int axis = 0; axis < 3; axis++)
+	{
+		const float extent = bounds[axis + 3] - bounds[axis];
+		scale[axis] = extent > 0.f ? ((1 << MORTON_BITS) - 1) / extent : 0.f;
+	}
+
+	//The star index in the low bits keeps every key unique
+	_keys.resize(count);
+	Parallel::forEach(chunkCount, [&](const size_t chunk)
+	{
+		for (size_t i = chunkBegin(chunk); i < chunkBegin(chunk + 1); i++)
+		{
+			float x, y, z;
+			toCamera(i, x, y, z);
+			const uint32_t code = (expandBits(uint32_t((x - bounds[0]) * scale[0])) << 2) | (expandBits(uint32_t((y - bounds[1]) * scale[1])) << 1) | expandBits(uint32_t((z - bounds[2]) * scale[2]));
+			_keys[i] = (uint64_t(code) << 32) | uint64_t(i);
+		}
+		std::sort(_keys.begin() + chunkBegin(chunk), _keys.begin() + chunkBegin(chunk + 1));
+	});
+
+	//Sorted chunks are merged pairwise
+	for (size_t width = 1; width < chunkCount; width *= 2)
+	{
+		Parallel::forEach((chunkCount + 2 * width - 1) / (2 * width), [&](const size_t pair)
+		{
+			const size_t first = pair * 2 * width;
+			if (first + width >= chunkCount) return;
+			std::inplace_merge(_keys.begin() + chunkBegin(first), _keys.begin() + chunkBegin(first + width), _keys.begin() + chunkBegin(std::min(first + 2 * width, chunkCount)));
+		});
+	}
+
+	_centerX.resize(count);
+	_centerY.resize(count);
+	_centerZ.resize(count);
+	_nodes.resize(std::max<size_t>(count - 1, 1));
+	_parents.resize(2 * count - 1);
+	const std::unique_ptr<std::atomic<uint32_t>[]> visits(new std::atomic<uint32_t>[std::max<size_t>(count - 1, 1)]);
+
+	if (count == 1)
+	{
+		//A single leaf under a root that repeats it
+		toCamera(size_t(_keys[0] & 0xFFFFFFFFu), _centerX[0], _centerY[0], _centerZ[0]);
+		_nodes[0] = {_centerX[0] - STELLAR_RADIUS, _centerY[0] - STELLAR_RADIUS, _centerZ[0] - STELLAR_RADIUS, _centerX[0] + STELLAR_RADIUS, _centerY[0] + STELLAR_RADIUS, _centerZ[0] + STELLAR_RADIUS, LEAF_FLAG, LEAF_FLAG};
+		return;
+	}
+
+	//Common prefix length of two keys, -1 outside the range
+	auto delta = [&](const int64_t i, const int64_t j) -> int
+	{
+		if (j < 0 || j >= int64_t(count)) return -1;
+		return Simd::countLeadingZeros(_keys[i] ^ _keys[j]);
+	};
+
+	//Every internal node finds its key range and split on its own (Karras 2012)
+	Parallel::forEach(chunkCount, [&](const size_t chunk)
+	{
+		const size_t end = std::min(chunkBegin(chunk + 1), count - 1);
+		for (size_t node = chunkBegin(chunk); node < end; node++)
+		{
+			const int64_t i = int64_t(node);
+			toCamera(size_t(_keys[i] & 0xFFFFFFFFu), _centerX[i], _centerY[i], _centerZ[i]);
+			visits[i].store(0, std::memory_order_relaxed);
+
+			const int64_t direction = delta(i, i + 1) > delta(i, i - 1) ? 1 : -1;
+			const int minDelta = delta(i, i - direction);
+			int64_t maxLength = 2;
+			while (delta(i, i + maxLength * direction) > minDelta) maxLength *= 2;
+			int64_t length = 0;
+			for (int64_t step = maxLength / 2; step >= 1; step /= 2)
+			{
+				if (delta(i, i + (length + step) * direction) > minDelta) length += step;
+			}
+			const int64_t j = i + length * direction;
+
+			const int nodeDelta = delta(i, j);
+			int64_t split = 0;
+			for (int64_t step = (length + 1) / 2; ; step = (step + 1) / 2)
+			{
+				if (delta(i, i + (split + step) * direction) > nodeDelta) split += step;
+				if (step == 1) break;
+			}
+			const int64_t gamma = i + split * direction + std::min<int64_t>(direction, 0);
+
+			Node& current = _nodes[node];
+			current.left = std::min(i, j) == gamma ? LEAF_FLAG | uint32_t(gamma) : uint32_t(gamma);
+			current.right = std::max(i, j) == gamma + 1 ? LEAF_FLAG | uint32_t(gamma + 1) : uint32_t(gamma + 1);
+			_parents[current.left & LEAF_FLAG ? count - 1 + gamma : gamma] = uint32_t(node);
+			_parents[current.right & LEAF_FLAG ? count + gamma : gamma + 1] = uint32_t(node);
+		}
+	});
+	toCamera(size_t(_keys[count - 1] & 0xFFFFFFFFu), _centerX[count - 1], _centerY[count - 1], _centerZ[count - 1]);
+
+	//Bounds bottom-up, the second child to arrive at a node computes it
+	Parallel::forEach(chunkCount, [&](const size_t chunk)
+	{
+		for (size_t leaf = chunkBegin(chunk); leaf < chunkBegin(chunk + 1); leaf++)
+		{
+			uint32_t node = _parents[count - 1 + leaf];
+			while (visits[node].fetch_add(1, std::memory_order_acq_rel) == 1)
+			{
+				float left[6], right[6];
+				Node& current = _nodes[node];
+				childBounds(current.left, left);
+				childBounds(current.right, right);
+				current.minX = std::min(left[0], right[0]);
+				current.minY = std::min(left[1], right[1]);
+				current.minZ = std::min(left[2], right[2]);
+				current.maxX = std::max(left[3], right[3]);
+				current.maxY = std::max(left[4], right[4]);
+				current.maxZ = std::max(left[5], right[5]);
+				if (node == 0) break;
+				node = _parents[node];
+			}
+		}
+	});
+}
+
+void SightLines::childBounds(const uint32_t child, float* outBounds) const
+{
+	if (child & LEAF_FLAG)
+	{
+		const uint32_t leaf = child & ~LEAF_FLAG;
+		outBounds[0] = _centerX[leaf] - STELLAR_RADIUS;
+		outBounds[1] = _centerY[leaf] - STELLAR_RADIUS;
+		outBounds[2] = _centerZ[leaf] - STELLAR_RADIUS;
+		outBounds[3] = _centerX[leaf] + STELLAR_RADIUS;
+		outBounds[4] = _centerY[leaf] + STELLAR_RADIUS;
+		outBounds[5] = _centerZ[leaf] + STELLAR_RADIUS;
+		return;
+	}
+	const Node& node = _nodes[child];
+	outBounds[0] = node.minX;
+	outBounds[1] = node.minY;
+	outBounds[2] = node.minZ;
+	outBounds[3] = node.maxX;
+	outBounds[4] = node.maxY;
+	outBounds[5] = node.maxZ;
+}
+
+void SightLines::trace(RayPacket& packet) const
+{
+	float inverseX[PACKET_SIZE], inverseY[PACKET_SIZE], inverseZ[PACKET_SIZE];
+	for (int lane = 0; lane < PACKET_SIZE; lane++)
+	{
+		//Rays start at the origin, a zero component would turn 0 * inf slab bounds into NaN
+		inverseX[lane] = 1.f / (packet.directionX[lane] != 0.f ? packet.directionX[lane] : 1e-30f);
+		inverseY[lane] = 1.f / (packet.directionY[lane] != 0.f ? packet.directionY[lane] : 1e-30f);
+		inverseZ[lane] = 1.f / (packet.directionZ[lane] != 0.f ? packet.directionZ[lane] : 1e-30f);
+	}
+
+	//Whether any ray of the packet enters the box before its current hit, and the nearest entry
+	auto hitsBox = [&](const float* bounds, float& outNearest)
+	{
+		bool hit = false;
+		outNearest = std::numeric_limits<float>::infinity();
+		for (int lane = 0; lane < PACKET_SIZE; lane++)
+		{
+			const float x0 = bounds[0] * inverseX[lane], x1 = bounds[3] * inverseX[lane];
+			const float y0 = bounds[1] * inverseY[lane], y1 = bounds[4] * inverseY[lane];
+			const float z0 = bounds[2] * inverseZ[lane], z1 = bounds[5] * inverseZ[lane];
+			const float tNear = std::max(std::max(std::min(x0, x1), std::min(y0, y1)), std::max(std::min(z0, z1), 0.f));
+			const float tFar = std::min(std::min(std::max(x0, x1), std::max(y0, y1)), std::max(z0, z1));
+			const bool laneHit = tNear <= tFar && tNear < packet.hitDistance[lane];
+			hit |= laneHit;
+			outNearest = laneHit ? std::min(outNearest, tNear) : outNearest;
+		}
+		return hit;
+	};
+
+	auto intersectSphere = [&](const uint32_t leaf)
+	{
+		const float centerX = _centerX[leaf];
+		const float centerY = _centerY[leaf];
+		const float centerZ = _centerZ[leaf];
+		const float centerOffset = centerX * centerX + centerY * centerY + centerZ * centerZ - STELLAR_RADIUS * STELLAR_RADIUS;
+		for (int lane = 0; lane < PACKET_SIZE; lane++)
+		{
+			//Squared distance of the center from the ray instead of b^2 - |c|^2, which cancels for far stars
+			const float b = packet.directionX[lane] * centerX + packet.directionY[lane] * centerY + packet.directionZ[lane] * centerZ;
+			const float offsetX = centerX - b * packet.directionX[lane];
+			const float offsetY = centerY - b * packet.directionY[lane];
+			const float offsetZ = centerZ - b * packet.directionZ[lane];
+			const float discriminant = STELLAR_RADIUS * STELLAR_RADIUS - (offsetX * offsetX + offsetY * offsetY + offsetZ * offsetZ);
+			if (discriminant < 0.f) continue;
+
+			//The camera inside a star sees its surface at once
+			const float t = centerOffset <= 0.f ? 0.f : b - std::sqrt(discriminant);
+			if (t >= 0.f && t < packet.hitDistance[lane]) packet.hitDistance[lane] = t;
+		}
+	};
+
+	float rootBounds[6];
+	float nearest;
+	childBounds(0, rootBounds);
+	if (!hitsBox(rootBounds, nearest)) return;
+
+	uint32_t stack[STACK_SIZE];
+	int stackSize = 0;
+	stack[stackSize++] = 0;
+	while (stackSize > 0)
+	{
+		const uint32_t node = stack[--stackSize];
+		if (node & LEAF_FLAG)
+		{
+			intersectSphere(node & ~LEAF_FLAG);
+			continue;
+		}
+
+		//Children are visited near first so their hits cull the far one
+		const Node& current = _nodes[node];
+		float leftBounds[6], rightBounds[6];
+		float leftNearest, rightNearest;
+		childBounds(current.left, leftBounds);
+		childBounds(current.right, rightBounds);
+		const bool hitsLeft = hitsBox(leftBounds, leftNearest);
+		const bool hitsRight = hitsBox(rightBounds, rightNearest);
+		if (hitsLeft && hitsRight)
+		{
+			stack[stackSize++] = leftNearest < rightNearest ? current.right : current.left;
+			stack[stackSize++] = leftNearest < rightNearest ? current.left : current.right;
+		}
+		else if (hitsLeft) stack[stackSize++] = current.left;
+		else if (hitsRight) stack[stackSize++] = current.right;
+	}
+}
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+
+#include "Frustum.h"
+
+//Random sight lines from the camera through the FOV, traced against the star spheres in packets.
+//Every shell/level gets its own bounding volume hierarchy, the rays only keep their nearest hit so far
+class SightLines
+{
+public:
+	//Rays that trace one node together, drawn from the same cell of the FOV so they stay coherent
+	static constexpr int PACKET_SIZE = 8;
+
+	//Casts at least rayCount rays, rounded up to fill a grid of packets over the FOV. 0 disables them
+	void reset(const size_t rayCount, const uint64_t seed, const Frustum& frustum);
+	bool isEnabled() const { return !_packets.empty(); };
+
+	//Builds the hierarchy of a culled shell and traces every ray that hasn't hit a nearer star against it
+	void addShell(const StarShellView& shell);
+
+	size_t rayCount() const { return _packets.size() * PACKET_SIZE; };
+	int shellCount() const { return int(_coveringFraction.size()); };
+
+	//Solid angle weighted fraction of the sight lines ending on a star surface after a shell
+	double coveringFraction(const int shellIndex) const { return _coveringFraction[shellIndex]; };
+	//Mean distance to the first star surface along the sight lines that hit one, NaN if none did
+	double meanHitDistance(const int shellIndex) const { return _meanHitDistance[shellIndex]; };
+
+private:
+	//Packets per tracing task
+	static constexpr size_t PACKETS_PER_TASK = 64;
+	//Stars per build task, smaller shells aren't split
+	static constexpr size_t MIN_CHUNK_STARS = 1 << 14;
+	//Leaves and internal nodes share the child index, leaves have the high bit set
+	static constexpr uint32_t LEAF_FLAG = 0x80000000u;
+	//Traversal stack, the tree depth is bounded by the 64 key bits
+	static constexpr int STACK_SIZE = 2 * 64;
+	//Random stream of the ray directions, generators key their streams by shell index
+	static constexpr uint32_t RANDOM_STREAM = UINT32_MAX;
+
+	//Camera space, looking down +z from the origin. Rays weigh by the solid angle of their tangent plane sample, directionZ^3
+	struct RayPacket
+	{
+		float directionX[PACKET_SIZE];
+		float directionY[PACKET_SIZE];
+		float directionZ[PACKET_SIZE];
+		float hitDistance[PACKET_SIZE];
+	};
+
+	struct Node
+	{
+		float minX, minY, minZ;
+		float maxX, maxY, maxZ;
+		uint32_t left;
+		uint32_t right;
+	};
+
+	Matrix4 _viewProjectionMatrix{};
+	double _tanHalfWidth = 0.;
+	double _tanHalfHeight = 0.;
+	std::vector<RayPacket> _packets;
+	double _totalWeight = 0.;
+
+	//Hierarchy of the last shell, reused between shells
+	std::vector<float> _centerX;
+	std::vector<float> _centerY;
+	std::vector<float> _centerZ;
+	std::vector<uint64_t> _keys;
+	std::vector<Node> _nodes;
+	std::vector<uint32_t> _parents; //Internal nodes followed by the leaves
+
+	std::vector<double> _coveringFraction;
+	std::vector<double> _meanHitDistance;
+
+	static double rayWeight(const RayPacket& packet, const int lane)
+	{
+		const double directionZ = packet.directionZ[lane];
+		return directionZ * directionZ * directionZ;
+	};
+
+	void build(const StarShellView& shell);
+	//Box of a node or of a leaf sphere as min xyz, max xyz
+	void childBounds(const uint32_t child, float* outBounds) const;
+	void trace(RayPacket& packet) const;
+};
@@ -0,0 +1,43 @@
+#include "Simd.h"
+
+#include <atomic>
+#include <algorithm>
+
+static std::atomic<int> maxSimdLevel{int(SimdLevel::AVX2)};
+
+static SimdLevel detectLevel()
+{
+#if OLBERS_SIMD_X86 && (defined(__GNUC__) || defined(__clang__))
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) return SimdLevel::AVX2;
+	if (__builtin_cpu_supports("sse2")) return SimdLevel::SSE;
+	return SimdLevel::SCALAR;
+#elif OLBERS_SIMD_X86 && defined(_MSC_VER)
+	//AVX2 paths need GCC/Clang target attributes, SSE2 is baseline on x64
+	return SimdLevel::SSE;
+#else
+	return SimdLevel::SCALAR;
+#endif
+}
+
+SimdLevel Simd::level()
+{
+	static const SimdLevel detected = detectLevel();
+	return SimdLevel(std::min(int(detected), maxSimdLevel.load()));
+}
+
+void Simd::setMaxLevel(const SimdLevel maxLevel)
+{
+	maxSimdLevel = int(maxLevel);
+}
+
+const char* Simd::levelName(const SimdLevel level)
+{
+	switch (level)
+	{
+		case SimdLevel::AVX2: return "AVX2";
+		case SimdLevel::SSE: return "SSE";
+		case SimdLevel::SCALAR: return "scalar";
+	}
+	return "unknown";
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__)
+#define OLBERS_SIMD_X86 1
+#include <immintrin.h>
+#else
+#define OLBERS_SIMD_X86 0
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if OLBERS_SIMD_X86 && (defined(__GNUC__) || defined(__clang__))
+#define OLBERS_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#define OLBERS_TARGET_SSE __attribute__((target("sse2")))
+#else
+#define OLBERS_TARGET_AVX2
+#define OLBERS_TARGET_SSE
+#endif
+
+enum class SimdLevel
+{
+	SCALAR,
+	SSE,
+	AVX2
+};
+
+namespace Simd
+{
+	inline int popCount(unsigned int mask)
+	{
+#if defined(_MSC_VER) && !defined(__clang__)
+		return int(__popcnt(mask));
+#else
+		return __builtin_popcount(mask);
+#endif
+	}
+
+	inline int countTrailingZeros(unsigned int mask)
+	{
+#if defined(_MSC_VER) && !defined(__clang__)
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return int(index);
+#else
+		return __builtin_ctz(mask);
+#endif
+	}
+
+	//Undefined for 0
+	inline int countLeadingZeros(unsigned long long value)
+	{
+#if defined(_MSC_VER) && !defined(__clang__)
+		unsigned long index;
+		_BitScanReverse64(&index, value);
+		return 63 - int(index);
+#else
+		return __builtin_clzll(value);
+#endif
+	}
+
+	//Best instruction set supported by the running CPU, capped by setMaxLevel()
+	SimdLevel level();
+	void setMaxLevel(const SimdLevel maxLevel);
+	const char* levelName(const SimdLevel level);
+}
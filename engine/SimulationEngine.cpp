@@ -0,0 +1,311 @@
+#include "SimulationEngine.h"
+
+#include "HalleyGenerator.h"
+#include "FractalGenerator.h"
+#include "Trace.h"
+
+SimulationEngine::SimulationEngine(const SimulationParameters& parameters)
+{
+	_parameters = parameters;
+	_frustum = defaultFrustum();
+	createGenerator();
+}
+
+void SimulationEngine::createGenerator()
+{
+	switch (_parameters.method)
+	{
+		case clusteringMethod::HALLEY:
+			_generator = std::make_unique<HalleyGenerator>(_parameters.shellCount, _parameters.shellThickness, _parameters.firstShellDistance, _parameters.seed, _parameters.tolerance, _parameters.sampleCount);
+			break;
+		case clusteringMethod::FRACTAL:
+			_generator = std::make_unique<FractalGenerator>(_parameters.levelCount, _parameters.countPerLevel, _parameters.spacing, _parameters.placeZeroStar);
+			break;
+	}
+}
+
+Frustum SimulationEngine::defaultFrustum()
+{
+	//Camera at the origin looking down -z, view matrix is identity
+	const Matrix4 projection = Frustum::perspective(CAMERA_VFOV, CAMERA_ASPECT_RATIO, CAMERA_NEAR_CLIP_PLANE, CAMERA_FAR_CLIP_PLANE);
+	return Frustum(projection.data());
+}
+
+void SimulationEngine::setViewProjectionMatrix(const float* viewProjectionMatrix)
+{
+	_frustum = Frustum(viewProjectionMatrix);
+}
+
+void SimulationEngine::setCatalogOutput(const std::string& path, const bool outOfCore)
+{
+	_catalogPath = path;
+	_outOfCore = outOfCore && !path.empty();
+}
+
+bool SimulationEngine::generate(const CancellationToken& cancellation)
+{
+	OLBERS_TRACE_SCOPE("generate", "engine");
+
+	_catalog.clear();
+	_mappedCatalog.close();
+	_flux.clear();
+	_error.clear();
+
+	for (const CheckpointRecord& record : _resumeState.records) _flux.restoreShell(record.shellStarCount, record.shellFlux, CompensatedSum(record.cumulativeFluxSum, record.cumulativeFluxCompensation));
+	_shellTimings.assign(_resumeState.records.size(), ShellTiming());
+
+	if (_firstShell > 0 && !_catalogPath.empty())
+	{
+		_error = "A resumed run can't write a catalog, it wouldn't contain the resumed shells";
+		return false;
+	}
+	if (_firstShell > 0 && !_skyMapPath.empty())
+	{
+		_error = "A resumed run can't write a sky map, it wouldn't contain the resumed shells";
+		return false;
+	}
+	if (_firstShell > 0 && _occlusionWidth > 0)
+	{
+		_error = "A resumed run can't compute occlusion, the resumed shells' stars aren't available";
+		return false;
+	}
+	if (_firstShell > 0 && _sightLineCount > 0)
+	{
+		_error = "A resumed run can't cast sight lines, the resumed shells' stars aren't available";
+		return false;
+	}
+	if (_parameters.isAdaptive() && !_catalogPath.empty())
+	{
+		_error = "An adaptive run can't write a catalog, sampled shells only hold a few of their stars";
+		return false;
+	}
+	if (_parameters.isAdaptive() && (!_skyMapPath.empty() || _occlusionWidth > 0 || _sightLineCount > 0))
+	{
+		_error = "An adaptive run can't map, occlude or trace the stars, sampled shells only hold a few of them";
+		return false;
+	}
+	if (_parameters.isAdaptive() && !_checkpointPath.empty())
+	{
+		_error = "An adaptive run can't write a checkpoint, its stopping point depends on every shell before it";
+		return false;
+	}
+	_skyMap.reset(_skyMapPath.empty() ? 0 : _skyMapWidth, _skyMapHeight, _frustum);
+	_occlusion.reset(_occlusionWidth, _occlusionHeight, _frustum);
+	_sightLines.reset(_sightLineCount, _parameters.seed, _frustum);
+	if (!_checkpointPath.empty() && !openCheckpointOutput()) return false;
+	if (!_catalogPath.empty() && !_catalogWriter.open(_catalogPath, _parameters, _frustum.viewProjectionMatrix()))
+	{
+		_error = _catalogWriter.error();
+		return false;
+	}
+	if (!openSkyMap()) return false;
+
+	_lastShellTime = Trace::now();
+	_generator->generate(_frustum, *this, _firstShell, cancellation);
+
+	if (!_checkpointWriter.error().empty())
+	{
+		_error = _checkpointWriter.error();
+		return false;
+	}
+	if (!closeSkyMap()) return false;
+
+	if (!_catalogWriter.isOpen()) return true;
+	if (!_catalogWriter.close())
+	{
+		_error = _catalogWriter.error();
+		return false;
+	}
+
+	//The shells weren't kept, read them back without copying
+	if (_outOfCore && !_mappedCatalog.open(_catalogPath))
+	{
+		_error = _mappedCatalog.error();
+		return false;
+	}
+	return true;
+}
+
+void SimulationEngine::addShell(StarShell&& shell)
+{
+	const int64_t received = Trace::now();
+	CompactShell compact;
+	if (_compactStorage)
+	{
+		compact = CompactShell::encode(shell);
+		compact.decode(shell);
+		_flux.addShell(compact, shell.weight, shell.fluxVariance);
+	}
+	else _flux.addShell(shell, shell.weight, shell.fluxVariance);
+	const int64_t reduced = Trace::now();
+	_shellTimings.push_back({(received - _lastShellTime) * 1e-6, (reduced - received) * 1e-6});
+	if (_checkpointOnGenerate && _checkpointWriter.isOpen()) _checkpointWriter.writeShell(_flux.shellCount() - 1, _flux);
+	if (_catalogWriter.isOpen()) _catalogWriter.writeShell(shell);
+	_skyMap.addShell(shell);
+	_occlusion.addShell(shell);
+	_sightLines.addShell(shell);
+	if (!_outOfCore && _compactStorage) _catalog.addShell(std::move(compact));
+	else if (!_outOfCore) _catalog.addShell(std::move(shell));
+	_lastShellTime = Trace::now();
+}
+
+bool SimulationEngine::openCatalog(const std::string& path)
+{
+	_resumeState = CheckpointState();
+	_resumePath.clear();
+	_firstShell = 0;
+
+	_catalog.clear();
+	_flux.clear();
+	_shellTimings.clear();
+	_error.clear();
+
+	if (!_mappedCatalog.open(path))
+	{
+		_error = _mappedCatalog.error();
+		return false;
+	}
+
+	_parameters = _mappedCatalog.parameters();
+	_frustum = Frustum(_mappedCatalog.viewProjectionMatrix().data());
+	createGenerator();
+
+	_skyMap.reset(_skyMapPath.empty() ? 0 : _skyMapWidth, _skyMapHeight, _frustum);
+	_occlusion.reset(_occlusionWidth, _occlusionHeight, _frustum);
+	_sightLines.reset(_sightLineCount, _parameters.seed, _frustum);
+	if (!openSkyMap()) return false;
+	for (int shellIndex = 0; shellIndex < _mappedCatalog.shellCount(); shellIndex++)
+	{
+		_flux.addShell(_mappedCatalog.shell(shellIndex));
+		_skyMap.addShell(_mappedCatalog.shell(shellIndex));
+		_occlusion.addShell(_mappedCatalog.shell(shellIndex));
+		_sightLines.addShell(_mappedCatalog.shell(shellIndex));
+	}
+	return closeSkyMap();
+}
+
+StarShellView SimulationEngine::shell(const int shellIndex) const
+{
+	if (shellIndex < _firstShell) return StarShellView();
+	if (_mappedCatalog.isOpen()) return _mappedCatalog.shell(shellIndex);
+	if (_catalog.isCompact()) return StarShellView();
+	return _catalog.shell(shellIndex - _firstShell);
+}
+
+size_t SimulationEngine::storedStarCount(const int shellIndex) const
+{
+	if (shellIndex < _firstShell) return 0;
+	if (!_mappedCatalog.isOpen() && _catalog.isCompact()) return _catalog.compactShell(shellIndex - _firstShell).size();
+	return shell(shellIndex).size();
+}
+
+void SimulationEngine::setCheckpointOutput(const std::string& path, const bool onGenerate)
+{
+	_checkpointPath = path;
+	_checkpointOnGenerate = onGenerate;
+}
+
+bool SimulationEngine::openCheckpointOutput()
+{
+	//Continuing the resumed checkpoint only appends, a new one gets the resumed records first
+	bool opened = false;
+	if (_checkpointPath == _resumePath) opened = _checkpointWriter.append(_checkpointPath, _resumeState);
+	else
+	{
+		opened = _checkpointWriter.open(_checkpointPath, _parameters, _frustum.viewProjectionMatrix());
+		for (size_t i = 0; opened && i < _resumeState.records.size(); i++) opened = _checkpointWriter.writeRecord(_resumeState.records[i]);
+	}
+
+	if (!opened) _error = _checkpointWriter.error();
+	return opened;
+}
+
+bool SimulationEngine::writeCheckpoint(const int shellIndex)
+{
+	if (!_checkpointWriter.isOpen()) return false;
+	if (_checkpointWriter.writeShell(shellIndex, _flux)) return true;
+
+	_error = _checkpointWriter.error();
+	return false;
+}
+
+bool SimulationEngine::resumeCheckpoint(const std::string& path)
+{
+	_error.clear();
+	CheckpointState state;
+	if (!Checkpoint::read(path, state, _error)) return false;
+
+	_parameters = state.parameters;
+	_frustum = Frustum(state.viewProjectionMatrix.data());
+	createGenerator();
+
+	_resumeState = std::move(state);
+	_resumePath = path;
+	_firstShell = int(_resumeState.records.size());
+	if (_checkpointPath.empty()) _checkpointPath = path;
+	return true;
+}
+
+void SimulationEngine::setSkyMapOutput(const std::string& path, const int width, const int height)
+{
+	_skyMapPath = path;
+	_skyMapWidth = width;
+	_skyMapHeight = height;
+}
+
+void SimulationEngine::setOcclusionSize(const int width, const int height)
+{
+	_occlusionWidth = width > 0 && height > 0 ? width : 0;
+	_occlusionHeight = height;
+}
+
+bool SimulationEngine::openSkyMap()
+{
+	if (!_skyMap.isEnabled() || _skyMap.open(_skyMapPath)) return true;
+	_error = _skyMap.error();
+	return false;
+}
+
+bool SimulationEngine::closeSkyMap()
+{
+	if (!_skyMap.isOpen() || _skyMap.close()) return true;
+	_error = _skyMap.error();
+	return false;
+}
+
+bool SimulationEngine::exportPly(const std::string& path)
+{
+	if (!_mappedCatalog.isOpen() && _catalog.isCompact())
+	{
+		_error = "A compact run can't export a PLY point cloud, export it from a catalog written by the run instead";
+		return false;
+	}
+
+	std::vector<StarShellView> shells;
+	for (int shellIndex = 0; shellIndex < shellCount(); shellIndex++) shells.push_back(shell(shellIndex));
+
+	return CatalogFile::exportPly(path, shells, _error);
+}
+
+ShellResult SimulationEngine::getShellResult(const int shellIndex) const
+{
+	ShellResult result;
+	result.shellIndex = shellIndex;
+	result.starCount = _flux.cumulativeStarCount(shellIndex);
+	result.shellStarCount = _flux.shellStarCount(shellIndex);
+	result.brightness = Photometry::fromFlux(_flux.cumulativeFlux(shellIndex));
+	result.shellBrightness = Photometry::fromFlux(_flux.shellFlux(shellIndex));
+	result.surfaceBrightnessError = Photometry::surfaceBrightnessError(_flux.cumulativeFlux(shellIndex), _flux.cumulativeFluxVariance(shellIndex));
+	if (shellIndex < _occlusion.shellCount())
+	{
+		result.coveredFraction = _occlusion.coveredFraction(shellIndex);
+		result.occludedBrightness = Photometry::fromFlux(_occlusion.occludedFlux(shellIndex));
+	}
+	if (shellIndex < _sightLines.shellCount())
+	{
+		result.sightLineCoveringFraction = _sightLines.coveringFraction(shellIndex);
+		result.meanHitDistance = _sightLines.meanHitDistance(shellIndex);
+	}
+	if (shellIndex < int(_shellTimings.size())) result.timing = _shellTimings[shellIndex];
+	return result;
+}
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "Global.h"
+#include "SimulationParameters.h"
+#include "Frustum.h"
+#include "StarCatalog.h"
+#include "StarGenerator.h"
+#include "Photometry.h"
+#include "FluxAccumulator.h"
+#include "CatalogFile.h"
+#include "Checkpoint.h"
+#include "SkyMap.h"
+#include "OcclusionBuffer.h"
+#include "SightLines.h"
+
+//Wall time spent on a shell, zero for shells restored from a checkpoint
+struct ShellTiming
+{
+	double generation = 0.; //ms, since the previous shell was handed out
+	double reduction = 0.; //ms
+};
+
+struct ShellResult
+{
+	int shellIndex = 0;
+	size_t starCount = 0; //Stars in current and previous shells
+	size_t shellStarCount = 0;
+	Brightness brightness; //Current and previous shells
+	Brightness shellBrightness; //Current shell only
+	//95% confidence half-width of the surface brightness, 0 unless shells were sampled. mag*arcsec^-2
+	double surfaceBrightnessError = 0.;
+	//Only with an occlusion buffer, current and previous shells
+	double coveredFraction = 0.;
+	Brightness occludedBrightness;
+	//Only with sight lines, current and previous shells
+	double sightLineCoveringFraction = 0.;
+	double meanHitDistance = 0.; //pc, NaN if no sight line hit a star
+	ShellTiming timing;
+};
+
+//Headless star generation, culling and surface brightness reduction, shared by the GUI and the CLI
+class SimulationEngine : private ShellSink
+{
+public:
+	explicit SimulationEngine(const SimulationParameters& parameters);
+
+	void setViewProjectionMatrix(const float* viewProjectionMatrix);
+	void setFrustum(const Frustum& frustum){ _frustum = frustum; };
+
+	//Streams the generated shells to a catalog file. Out of core, shells aren't kept in memory and are read back from the mapped file
+	void setCatalogOutput(const std::string& path, const bool outOfCore = false);
+
+	//Keeps the generated shells as 16 bit grid coordinates in boxes of neighbouring stars, about half the memory of float positions.
+	//Positions are rounded to the grid before any stage sees them, so every result matches the kept stars
+	void setCompactStorage(const bool compact){ _compactStorage = compact; };
+	bool hasCompactStorage() const { return _compactStorage; };
+
+	//Returns false if the catalog output couldn't be written, see error()
+	bool generate(const CancellationToken& cancellation = CancellationToken());
+
+	//Maps a catalog file instead of generating, parameters and frustum are taken from it
+	bool openCatalog(const std::string& path);
+
+	//Appends a record to a checkpoint file for every completed shell. Shells complete when generated, or only through writeCheckpoint() if not onGenerate
+	void setCheckpointOutput(const std::string& path, const bool onGenerate = true);
+	bool writeCheckpoint(const int shellIndex);
+
+	//Restores the shells completed in a checkpoint, parameters and frustum are taken from it. generate() continues after them and keeps writing to the checkpoint
+	bool resumeCheckpoint(const std::string& path);
+	int resumedShellCount() const { return _firstShell; };
+
+	bool exportPly(const std::string& path);
+
+	//Bins the stars into a surface brightness map of the FOV while they are generated or a catalog is opened, written at the end
+	void setSkyMapOutput(const std::string& path, const int width, const int height);
+	const SkyMap& skyMap() const { return _skyMap; };
+
+	//Rasterizes the star disks into an angular depth buffer of the FOV, so near stars hide far ones. 0 disables it
+	void setOcclusionSize(const int width, const int height);
+	bool hasOcclusion() const { return _occlusion.isEnabled(); };
+	const OcclusionBuffer& occlusion() const { return _occlusion; };
+
+	//Traces random sight lines through the FOV against the star spheres of every shell/level. 0 disables them
+	void setSightLineCount(const size_t rayCount){ _sightLineCount = rayCount; };
+	bool hasSightLines() const { return _sightLines.isEnabled(); };
+	const SightLines& sightLines() const { return _sightLines; };
+
+	const SimulationParameters& parameters() const { return _parameters; };
+	const FluxAccumulator& flux() const { return _flux; };
+	const std::string& error() const { return _error; };
+
+	int shellCount() const { return _flux.shellCount(); };
+	size_t starCount() const { return shellCount() > 0 ? _flux.cumulativeStarCount(shellCount() - 1) : 0; };
+	//Empty for resumed shells, their stars aren't part of the checkpoint, and for compact shells, see forEachStar()
+	StarShellView shell(const int shellIndex) const;
+	//Stars kept of a shell whatever their storage, the sample of a sampled shell
+	size_t storedStarCount(const int shellIndex) const;
+
+	//Calls fn(x, y, z) with the position relative to the observer of every kept star in [begin, end) of a shell, whatever its storage
+	template<typename Fn>
+	void forEachStar(const int shellIndex, const size_t begin, const size_t end, Fn&& fn) const
+	{
+		if (shellIndex < _firstShell) return;
+		if (!_mappedCatalog.isOpen() && _catalog.isCompact()) _catalog.compactShell(shellIndex - _firstShell).forEachStar(begin, end, fn);
+		else shell(shellIndex).forEachStar(begin, end, fn);
+	}
+
+	ShellResult getShellResult(const int shellIndex) const;
+
+	static Frustum defaultFrustum();
+
+private:
+	virtual void addShell(StarShell&& shell) override;
+
+	void createGenerator();
+	bool openCheckpointOutput();
+	//The planes are written as the shells arrive
+	bool openSkyMap();
+	bool closeSkyMap();
+
+	SimulationParameters _parameters;
+	Frustum _frustum;
+	StarCatalog _catalog;
+	FluxAccumulator _flux;
+	std::unique_ptr<StarGenerator> _generator;
+	bool _compactStorage = false;
+
+	std::vector<ShellTiming> _shellTimings;
+	int64_t _lastShellTime = 0;
+
+	std::string _catalogPath;
+	bool _outOfCore = false;
+	CatalogWriter _catalogWriter;
+	MappedCatalog _mappedCatalog;
+
+	std::string _skyMapPath;
+	int _skyMapWidth = 0;
+	int _skyMapHeight = 0;
+	SkyMap _skyMap;
+
+	int _occlusionWidth = 0;
+	int _occlusionHeight = 0;
+	OcclusionBuffer _occlusion;
+
+	size_t _sightLineCount = 0;
+	SightLines _sightLines;
+
+	std::string _checkpointPath;
+	bool _checkpointOnGenerate = true;
+	CheckpointWriter _checkpointWriter;
+	std::string _resumePath;
+	CheckpointState _resumeState;
+	int _firstShell = 0;
+
+	std::string _error;
+};
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Global.h"
+
+struct SimulationParameters
+{
+	clusteringMethod method = clusteringMethod::HALLEY;
+
+	//Same seed and parameters always give the same catalog
+	uint64_t seed = 0;
+
+	//Halley
+	int shellCount = 1;
+	float shellThickness = 50.f;
+	float firstShellDistance = 1.29f;
+	//Adaptive sampling, 0 brute-forces every shell. mag*arcsec^-2
+	float tolerance = 0.f;
+	//Stars drawn per sampled shell
+	int sampleCount = 4096;
+
+	//Fractal
+	int levelCount = 1;
+	int countPerLevel = 2;
+	float spacing = 1.f;
+	bool placeZeroStar = false;
+
+	bool isAdaptive() const { return method == clusteringMethod::HALLEY && tolerance > 0.f; };
+};
@@ -0,0 +1,251 @@
+#include "SkyMap.h"
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <algorithm>
+
+#include "Global.h"
+#include "Photometry.h"
+#include "CatalogFile.h"
+#include "Parallel.h"
+#include "Trace.h"
+
+namespace
+{
+	constexpr double ARCSEC_PER_RADIAN = 180. * 3600. / M_PI;
+	constexpr size_t FITS_BLOCK_SIZE = 2880;
+	constexpr size_t FITS_CARD_SIZE = 80;
+
+	std::string fitsCard(const std::string& keyword, const std::string& value, const std::string& comment = std::string())
+	{
+		std::ostringstream card;
+		card << std::left << std::setw(8) << keyword << "= " << std::right << std::setw(20) << value;
+		if (!comment.empty()) card << " / " << comment;
+		std::string text = card.str();
+		text.resize(FITS_CARD_SIZE, ' ');
+		return text;
+	}
+
+	std::string fitsString(const std::string& value)
+	{
+		//Quoted strings are left aligned and at least 8 characters long
+		std::string padded = value;
+		if (padded.size() < 8) padded.resize(8, ' ');
+		std::string quoted = "'" + padded + "'";
+		quoted.resize(20, ' ');
+		return quoted;
+	}
+}
+
+double SkyMap::tangentRectangleSolidAngle(const double x0, const double y0, const double x1, const double y1)
+{
+	auto corner = [](const double x, const double y) { return std::atan(x * y / std::sqrt(1. + x * x + y * y)); };
+	return corner(x1, y1) - corner(x0, y1) - corner(x1, y0) + corner(x0, y0);
+}
+
+SkyMap::~SkyMap()
+{
+	//An unfinished run leaves a complete file of its shells so far
+	if (isOpen()) close();
+}
+
+void SkyMap::reset(const int width, const int height, const Frustum& frustum)
+{
+	_width = std::max(width, 0);
+	_height = std::max(height, 0);
+	_viewProjectionMatrix = frustum.viewProjectionMatrix();
+	_shellCount = 0;
+
+	const size_t pixelCount = size_t(_width) * _height;
+	_flux.assign(pixelCount, 0.);
+	_surfaceBrightness.clear();
+
+	//Pixels are even steps on the tangent plane, their solid angle shrinks towards the edges
+	const double tanHalfHeight = std::tan(CAMERA_VFOV * M_PI / 360.);
+	const double tanHalfWidth = CAMERA_ASPECT_RATIO * tanHalfHeight;
+	_pixelArea.resize(pixelCount);
+	for (int y = 0; y < _height; y++)
+	{
+		const double y0 = tanHalfHeight * (2. * y / _height - 1.);
+		const double y1 = tanHalfHeight * (2. * (y + 1) / _height - 1.);
+		for (int x = 0; x < _width; x++)
+		{
+			const double x0 = tanHalfWidth * (2. * x / _width - 1.);
+			const double x1 = tanHalfWidth * (2. * (x + 1) / _width - 1.);
+			_pixelArea[size_t(y) * _width + x] = tangentRectangleSolidAngle(x0, y0, x1, y1) * ARCSEC_PER_RADIAN * ARCSEC_PER_RADIAN;
+		}
+	}
+}
+
+bool SkyMap::open(const std::string& path)
+{
+	if (isOpen()) close();
+	_error.clear();
+	_raw = path.size() >= 4 && path.compare(path.size() - 4, 4, ".raw") == 0;
+	_dataSize = 0;
+
+	_file.open(path, std::ios::binary | std::ios::trunc);
+	if (!_file)
+	{
+		_error = "Unable to open \"" + path + "\" for writing";
+		return false;
+	}
+
+	//The plane count is patched in at close
+	if (!_raw)
+	{
+		const std::string header = fitsHeader();
+		_file.write(header.data(), header.size());
+	}
+	return true;
+}
+
+bool SkyMap::close()
+{
+	if (!_raw)
+	{
+		const std::string padding((FITS_BLOCK_SIZE - _dataSize % FITS_BLOCK_SIZE) % FITS_BLOCK_SIZE, '\0');
+		_file.write(padding.data(), padding.size());
+		const std::string header = fitsHeader();
+		_file.seekp(0);
+		_file.write(header.data(), header.size());
+	}
+
+	const bool ok = bool(_file);
+	if (!ok) _error = "Unable to write the sky map";
+	_file.close();
+	return ok;
+}
+
+void SkyMap::addShell(const StarShellView& shell)
+{
+	if (!isEnabled()) return;
+	OLBERS_TRACE_SCOPE("sky map", "brightness");
+
+	const size_t pixelCount = size_t(_width) * _height;
+	const size_t count = shell.size();
+	const size_t chunkCount = std::max<size_t>(1, std::min(size_t(Parallel::threadCount()), count / MIN_CHUNK_STARS));
+	const size_t chunkSize = (count + chunkCount - 1) / chunkCount;
+	_starPixel.resize(count);
+	_starFlux.resize(count);
+	_chunkPixelCounts.resize(std::max(_chunkPixelCounts.size(), chunkCount));
+
+	//Project the stars and count them per pixel
+	const double unitDistanceFlux = Photometry::apparentFlux(1.);
+	const Matrix4& m = _viewProjectionMatrix;
+	Parallel::forEach(chunkCount, [&](const size_t chunk)
+	{
+		std::vector<uint32_t>& counts = _chunkPixelCounts[chunk];
+		counts.assign(pixelCount, 0);
+		size_t star = chunk * chunkSize;
+		shell.forEachStar(star, std::min(count, (chunk + 1) * chunkSize), [&](const double px, const double py, const double pz)
+		{
+			//A pixel is far wider than the float spacing at any distance
+			const float x = float(px);
+			const float y = float(py);
+			const float z = float(pz);
+			const float clipW = m[3] * x + m[7] * y + m[11] * z + m[15];
+			if (clipW <= 0.f)
+			{
+				_starPixel[star++] = NO_PIXEL;
+				return;
+			}
+
+			const float ndcX = (m[0] * x + m[4] * y + m[8] * z + m[12]) / clipW;
+			const float ndcY = (m[1] * x + m[5] * y + m[9] * z + m[13]) / clipW;
+			const int pixelX = std::clamp(int((ndcX + 1.f) * 0.5f * _width), 0, _width - 1);
+			const int pixelY = std::clamp(int((ndcY + 1.f) * 0.5f * _height), 0, _height - 1);
+			const uint32_t pixel = uint32_t(size_t(pixelY) * _width + pixelX);
+
+			//Flux falls with the square of the distance
+			_starPixel[star] = pixel;
+			_starFlux[star++] = unitDistanceFlux / (px * px + py * py + pz * pz);
+			counts[pixel]++;
+		});
+	});
+
+	//Counts become write positions, every pixel keeps the star order of the shell
+	_pixelBegin.resize(pixelCount + 1);
+	std::vector<std::vector<size_t>> positions(chunkCount, std::vector<size_t>(pixelCount));
+	size_t position = 0;
+	for (size_t pixel = 0; pixel < pixelCount; pixel++)
+	{
+		_pixelBegin[pixel] = position;
+		for (size_t chunk = 0; chunk < chunkCount; chunk++)
+		{
+			positions[chunk][pixel] = position;
+			position += _chunkPixelCounts[chunk][pixel];
+		}
+	}
+	_pixelBegin[pixelCount] = position;
+	_pixelFlux.resize(position);
+
+	Parallel::forEach(chunkCount, [&](const size_t chunk)
+	{
+		std::vector<size_t>& next = positions[chunk];
+		for (size_t star = chunk * chunkSize; star < std::min(count, (chunk + 1) * chunkSize); star++)
+		{
+			if (_starPixel[star] != NO_PIXEL) _pixelFlux[next[_starPixel[star]]++] = _starFlux[star];
+		}
+	});
+
+	//Pixels are summed row by row in parallel
+	_surfaceBrightness.resize(pixelCount);
+	Parallel::forEach(size_t(_height), [&](const size_t row)
+	{
+		for (size_t pixel = row * _width; pixel < (row + 1) * _width; pixel++)
+		{
+			double shellFlux = 0.;
+			for (size_t i = _pixelBegin[pixel]; i < _pixelBegin[pixel + 1]; i++) shellFlux += _pixelFlux[i];
+			_flux[pixel] += shellFlux;
+			_surfaceBrightness[pixel] = _flux[pixel] > 0. ? float(-2.5 * std::log10(_flux[pixel]) + 2.5 * std::log10(_pixelArea[pixel])) : std::numeric_limits<float>::quiet_NaN();
+		}
+	});
+	_shellCount++;
+	if (isOpen()) writePlane();
+}
+
+void SkyMap::writePlane()
+{
+	if (_raw)
+	{
+		_file.write(reinterpret_cast<const char*>(_surfaceBrightness.data()), _surfaceBrightness.size() * sizeof(float));
+		return;
+	}
+
+	//FITS data is big-endian
+	_words.resize(_surfaceBrightness.size());
+	std::memcpy(_words.data(), _surfaceBrightness.data(), _surfaceBrightness.size() * sizeof(float));
+	if (CatalogFile::isLittleEndian())
+	{
+		for (uint32_t& word : _words) word = (word >> 24) | ((word >> 8) & 0xFF00u) | ((word << 8) & 0xFF0000u) | (word << 24);
+	}
+	_file.write(reinterpret_cast<const char*>(_words.data()), _words.size() * sizeof(uint32_t));
+	_dataSize += _words.size() * sizeof(uint32_t);
+}
+
+std::string SkyMap::fitsHeader() const
+{
+	std::string header;
+	header += fitsCard("SIMPLE", "T", "Standard FITS");
+	header += fitsCard("BITPIX", "-32", "IEEE single precision");
+	header += fitsCard("NAXIS", "3");
+	header += fitsCard("NAXIS1", std::to_string(_width), "Pixels across the FOV");
+	header += fitsCard("NAXIS2", std::to_string(_height), "Pixels up the FOV");
+	header += fitsCard("NAXIS3", std::to_string(_shellCount), "Shells/levels, cumulative");
+	header += fitsCard("BUNIT", fitsString("mag/arcsec2"), "Surface brightness");
+	header += fitsCard("CTYPE3", fitsString("SHELL"));
+	std::ostringstream hfov, vfov;
+	hfov << std::setprecision(8) << 2. * std::atan(CAMERA_ASPECT_RATIO * std::tan(CAMERA_VFOV * M_PI / 360.)) * 180. / M_PI;
+	vfov << std::setprecision(8) << CAMERA_VFOV;
+	header += fitsCard("HFOV", hfov.str(), "Horizontal field of view [deg]");
+	header += fitsCard("VFOV", vfov.str(), "Vertical field of view [deg]");
+	header += std::string("END").append(FITS_CARD_SIZE - 3, ' ');
+	header.resize((header.size() + FITS_BLOCK_SIZE - 1) / FITS_BLOCK_SIZE * FITS_BLOCK_SIZE, ' ');
+	return header;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <cstdint>
+
+#include "Frustum.h"
+
+//Sky surface brightness over the camera FOV, the flux of every star is binned into the pixel it projects to
+class SkyMap
+{
+public:
+	~SkyMap();
+
+	//Starts an empty map, pixel solid angles assume the default camera lens
+	void reset(const int width, const int height, const Frustum& frustum);
+	bool isEnabled() const { return _width > 0; };
+
+	//Streams a plane per shell to a FITS cube, or to bare native float planes if the extension is .raw
+	bool open(const std::string& path);
+	//Completes the file now that the shell count is known
+	bool close();
+	bool isOpen() const { return _file.is_open(); };
+	const std::string& error() const { return _error; };
+
+	//Bins the stars of a culled shell and writes its plane. Stars are binned per pixel in shell order, so the sums don't depend on the thread count
+	void addShell(const StarShellView& shell);
+
+	int width() const { return _width; };
+	int height() const { return _height; };
+	int shellCount() const { return _shellCount; };
+
+	//Cumulative surface brightness in mag/arcsec^2 after the last shell, rows from the bottom, NaN for pixels without stars
+	const std::vector<float>& surfaceBrightness() const { return _surfaceBrightness; };
+	double pixelArea(const int x, const int y) const { return _pixelArea[size_t(y) * _width + x]; }; //arcsec^2
+
+	//Solid angle of a pixel grid cell on the tangent plane at distance 1, in steradians
+	static double tangentRectangleSolidAngle(const double x0, const double y0, const double x1, const double y1);
+
+private:
+	//Stars per binning task, smaller shells aren't split
+	static constexpr size_t MIN_CHUNK_STARS = 1 << 14;
+	//Stars outside the FOV
+	static constexpr uint32_t NO_PIXEL = UINT32_MAX;
+
+	int _width = 0;
+	int _height = 0;
+	Matrix4 _viewProjectionMatrix{};
+	int _shellCount = 0;
+
+	std::vector<double> _pixelArea;
+	std::vector<double> _flux;
+	std::vector<float> _surfaceBrightness;
+
+	//Pixel and flux of every star of the last shell, then the fluxes grouped by pixel
+	std::vector<uint32_t> _starPixel;
+	std::vector<double> _starFlux;
+	std::vector<double> _pixelFlux;
+	std::vector<size_t> _pixelBegin;
+	std::vector<std::vector<uint32_t>> _chunkPixelCounts;
+
+	std::ofstream _file;
+	std::string _error;
+	bool _raw = false;
+	size_t _dataSize = 0;
+	std::vector<uint32_t> _words;
+
+	std::string fitsHeader() const;
+	void writePlane();
+};
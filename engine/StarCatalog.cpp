@@ -0,0 +1,418 @@
+#include "StarCatalog.h"
+
+#include <numeric>
+#include <cmath>
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <cstdint>
+#include <cstring>
+
+#include "Parallel.h"
+#include "Trace.h"
+
+namespace
+{
+	//Shells smaller than this are sorted on the calling thread
+	constexpr size_t PARALLEL_SORT_THRESHOLD = 1 << 16;
+
+	//Stars of an anchored shell gathered per task, a fixed size so the new anchors don't depend on the thread count
+	constexpr size_t ANCHOR_GATHER_CHUNK = 1 << 16;
+
+	constexpr int RADIX_BITS = 8;
+	constexpr size_t RADIX_SIZE = size_t(1) << RADIX_BITS;
+
+	template<typename Key>
+	struct SortEntry
+	{
+		Key key;
+		uint32_t index;
+	};
+
+	//The bit pattern of a non-negative float or double orders the same way as its value
+	template<typename Key, typename Real>
+	Key distanceKey(const Real px, const Real py, const Real pz)
+	{
+		static_assert(sizeof(Key) == sizeof(Real), "The key holds the bits of the squared distance");
+		const Real distanceSquared = px * px + py * py + pz * pz;
+		Key key;
+		std::memcpy(&key, &distanceSquared, sizeof(key));
+		return key;
+	}
+
+	template<typename Key>
+	size_t radixDigit(const Key key, const int pass)
+	{
+		return size_t(key >> (pass * RADIX_BITS)) & (RADIX_SIZE - 1);
+	}
+
+	//Stable LSD radix sort of the stars by key(i), returns the sorted entries, either entries or scratch
+	template<typename Key, typename KeyFn>
+	const SortEntry<Key>* radixSort(const size_t count, std::vector<SortEntry<Key>>& entries, std::vector<SortEntry<Key>>& scratch, KeyFn&& key)
+	{
+		constexpr int passCount = int(sizeof(Key)) * 8 / RADIX_BITS;
+		const size_t chunkCount = count < PARALLEL_SORT_THRESHOLD ? 1 : size_t(Parallel::threadCount());
+		const size_t chunkSize = (count + chunkCount - 1) / chunkCount;
+		auto chunkEnd = [&](const size_t chunk) { return std::min(count, (chunk + 1) * chunkSize); };
+
+		//Keys and the digit histograms of all passes in one read, the totals per digit do not depend on the order
+		entries.resize(count);
+		scratch.resize(count);
+		std::vector<std::array<size_t, RADIX_SIZE * passCount>> histograms(chunkCount);
+		Parallel::forEach(chunkCount, [&](const size_t chunk)
+		{
+			std::array<size_t, RADIX_SIZE * passCount>& histogram = histograms[chunk];
+			histogram.fill(0);
+			for (size_t i = chunk * chunkSize; i < chunkEnd(chunk); i++)
+			{
+				const Key starKey = key(i);
+				entries[i] = {starKey, uint32_t(i)};
+				for (int pass = 0; pass < passCount; pass++) histogram[pass * RADIX_SIZE + radixDigit(starKey, pass)]++;
+			}
+		});
+
+		//Stable LSD passes, each chunk scatters into its own slice of every bucket
+		SortEntry<Key>* source = entries.data();
+		SortEntry<Key>* destination = scratch.data();
+		std::vector<std::array<size_t, RADIX_SIZE>> offsets(chunkCount);
+		bool permuted = false;
+		for (int pass = 0; pass < passCount; pass++)
+		{
+			//All keys share this digit, the pass would not move anything
+			bool singleBucket = false;
+			for (size_t digit = 0; digit < RADIX_SIZE && !singleBucket; digit++)
+			{
+				size_t total = 0;
+				for (size_t chunk = 0; chunk < chunkCount; chunk++) total += histograms[chunk][pass * RADIX_SIZE + digit];
+				singleBucket = total == count;
+			}
+			if (singleBucket) continue;
+
+			//Earlier passes moved the entries between chunks
+			if (permuted && chunkCount > 1)
+			{
+				Parallel::forEach(chunkCount, [&](const size_t chunk)
+				{
+					size_t* histogram = histograms[chunk].data() + pass * RADIX_SIZE;
+					std::fill(histogram, histogram + RADIX_SIZE, 0);
+					for (size_t i = chunk * chunkSize; i < chunkEnd(chunk); i++) histogram[radixDigit(source[i].key, pass)]++;
+				});
+			}
+
+			size_t offset = 0;
+			for (size_t digit = 0; digit < RADIX_SIZE; digit++)
+			{
+				for (size_t chunk = 0; chunk < chunkCount; chunk++)
+				{
+					offsets[chunk][digit] = offset;
+					offset += histograms[chunk][pass * RADIX_SIZE + digit];
+				}
+			}
+
+			Parallel::forEach(chunkCount, [&](const size_t chunk)
+			{
+				std::array<size_t, RADIX_SIZE>& chunkOffsets = offsets[chunk];
+				for (size_t i = chunk * chunkSize; i < chunkEnd(chunk); i++) destination[chunkOffsets[radixDigit(source[i].key, pass)]++] = source[i];
+			});
+			std::swap(source, destination);
+			permuted = true;
+		}
+		return source;
+	}
+
+	//Grid steps of compact boxes, GRID_MAX steps of the largest stay finite in float
+	constexpr int MIN_GRID_EXPONENT = -64;
+	constexpr int MAX_GRID_EXPONENT = 100;
+	//Compact boxes span at most this many times the distance of their nearest star, so the grid step stays below 2^-12 of every star's distance
+	constexpr double MAX_BOX_EXTENT_RATIO = 8.;
+	//Compact boxes encoded per task
+	constexpr size_t BOXES_PER_TASK = 64;
+}
+
+void StarShell::reserve(const size_t count)
+{
+	x.reserve(count);
+	y.reserve(count);
+	z.reserve(count);
+}
+
+void StarShell::append(const float px, const float py, const float pz)
+{
+	x.push_back(px);
+	y.push_back(py);
+	z.push_back(pz);
+}
+
+void StarShell::anchor(const double ax, const double ay, const double az)
+{
+	//Earlier stars stay relative to the observer
+	if (anchors.empty() && !x.empty()) anchors.push_back({0., 0., 0., 0});
+	if (!anchors.empty() && anchors.back().begin == x.size()) anchors.pop_back();
+	anchors.push_back({ax, ay, az, x.size()});
+}
+
+void StarShell::clear()
+{
+	x.clear();
+	y.clear();
+	z.clear();
+	anchors.clear();
+	weight = 1.;
+	fluxVariance = 0.;
+}
+
+void StarShell::sortByDistance()
+{
+	OLBERS_TRACE_SCOPE("sort", "sorting");
+	const size_t count = size();
+	if (count < 2) return;
+
+	//The index is stored in 32 bits, larger shells fall back to a comparison sort
+	if (count > std::numeric_limits<uint32_t>::max())
+	{
+		std::vector<double> distanceSquared(count);
+		const StarShellView view(*this);
+		size_t star = 0;
+		view.forEachStar(0, count, [&](const double px, const double py, const double pz) { distanceSquared[star++] = px * px + py * py + pz * pz; });
+		std::vector<size_t> order(count);
+		std::iota(order.begin(), order.end(), 0);
+		std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b)
+		{
+			return distanceSquared[a] < distanceSquared[b];
+		});
+
+		//Every star keeps its own anchor
+		StarShell sorted;
+		sorted.reserve(count);
+		sorted.weight = weight;
+		sorted.fluxVariance = fluxVariance;
+		for (size_t star : order)
+		{
+			if (!anchors.empty())
+			{
+				const StarAnchor& anchor = *(std::upper_bound(anchors.begin(), anchors.end(), uint64_t(star), [](const uint64_t index, const StarAnchor& a) { return index < a.begin; }) - 1);
+				sorted.anchor(anchor.x, anchor.y, anchor.z);
+			}
+			sorted.append(x[star], y[star], z[star]);
+		}
+		*this = std::move(sorted);
+		return;
+	}
+
+	if (anchors.empty())
+	{
+		std::vector<SortEntry<uint32_t>> entries;
+		std::vector<SortEntry<uint32_t>> scratch;
+		const SortEntry<uint32_t>* order = radixSort<uint32_t>(count, entries, scratch, [&](const size_t i) { return distanceKey<uint32_t>(x[i], y[i], z[i]); });
+
+		//Single permutation gather
+		const size_t chunkCount = count < PARALLEL_SORT_THRESHOLD ? 1 : size_t(Parallel::threadCount());
+		const size_t chunkSize = (count + chunkCount - 1) / chunkCount;
+		StarShell sorted;
+		sorted.x.resize(count);
+		sorted.y.resize(count);
+		sorted.z.resize(count);
+		sorted.weight = weight;
+		sorted.fluxVariance = fluxVariance;
+		Parallel::forEach(chunkCount, [&](const size_t chunk)
+		{
+			for (size_t i = chunk * chunkSize; i < std::min(count, (chunk + 1) * chunkSize); i++)
+			{
+				const uint32_t star = order[i].index;
+				sorted.x[i] = x[star];
+				sorted.y[i] = y[star];
+				sorted.z[i] = z[star];
+			}
+		});
+		*this = std::move(sorted);
+		return;
+	}
+
+	//Anchored stars are ordered by their double distance over the whole shell
+	std::vector<uint32_t> starAnchor(count);
+	for (size_t segment = 0; segment < anchors.size(); segment++)
+	{
+		const size_t end = segment + 1 < anchors.size() ? anchors[segment + 1].begin : count;
+		std::fill(starAnchor.begin() + anchors[segment].begin, starAnchor.begin() + end, uint32_t(segment));
+	}
+	std::vector<SortEntry<uint64_t>> entries;
+	std::vector<SortEntry<uint64_t>> scratch;
+	const SortEntry<uint64_t>* order = radixSort<uint64_t>(count, entries, scratch, [&](const size_t i)
+	{
+		const StarAnchor& anchor = anchors[starAnchor[i]];
+		return distanceKey<uint64_t>(anchor.x + x[i], anchor.y + y[i], anchor.z + z[i]);
+	});
+
+	//Neighbours in distance come from different clusters. A star keeps the anchor of the previous one when its offset from it is
+	//exact in float, otherwise its own anchor starts a new segment, so no star moves. Every gather chunk starts a new segment
+	const size_t chunkCount = (count + ANCHOR_GATHER_CHUNK - 1) / ANCHOR_GATHER_CHUNK;
+	std::vector<std::vector<StarAnchor>> chunkAnchors(chunkCount);
+	StarShell sorted;
+	sorted.x.resize(count);
+	sorted.y.resize(count);
+	sorted.z.resize(count);
+	sorted.weight = weight;
+	sorted.fluxVariance = fluxVariance;
+	Parallel::forEach(chunkCount, [&](const size_t chunk)
+	{
+		std::vector<StarAnchor>& outAnchors = chunkAnchors[chunk];
+		uint32_t sourceAnchor = UINT32_MAX;
+		for (size_t i = chunk * ANCHOR_GATHER_CHUNK; i < std::min(count, (chunk + 1) * ANCHOR_GATHER_CHUNK); i++)
+		{
+			const uint32_t star = order[i].index;
+			if (starAnchor[star] == sourceAnchor)
+			{
+				sorted.x[i] = x[star];
+				sorted.y[i] = y[star];
+				sorted.z[i] = z[star];
+				continue;
+			}
+
+			const StarAnchor& anchor = anchors[starAnchor[star]];
+			if (!outAnchors.empty())
+			{
+				const StarAnchor& current = outAnchors.back();
+				const double offsetX = anchor.x - current.x + x[star];
+				const double offsetY = anchor.y - current.y + y[star];
+				const double offsetZ = anchor.z - current.z + z[star];
+				if (double(float(offsetX)) == offsetX && double(float(offsetY)) == offsetY && double(float(offsetZ)) == offsetZ)
+				{
+					sorted.x[i] = float(offsetX);
+					sorted.y[i] = float(offsetY);
+					sorted.z[i] = float(offsetZ);
+					continue;
+				}
+			}
+
+			outAnchors.push_back({anchor.x, anchor.y, anchor.z, i});
+			sourceAnchor = starAnchor[star];
+			sorted.x[i] = x[star];
+			sorted.y[i] = y[star];
+			sorted.z[i] = z[star];
+		}
+	});
+	for (const std::vector<StarAnchor>& chunk : chunkAnchors) sorted.anchors.insert(sorted.anchors.end(), chunk.begin(), chunk.end());
+	*this = std::move(sorted);
+}
+
+CompactShell CompactShell::encode(const StarShellView& shell)
+{
+	OLBERS_TRACE_SCOPE("compact", "engine");
+	const size_t count = shell.size();
+	CompactShell compact;
+	compact.x.resize(count);
+	compact.y.resize(count);
+	compact.z.resize(count);
+	if (count == 0) return compact;
+
+	//Boxes take the stars in order until they are full or would grow too large for their nearest star
+	std::vector<size_t> boxBegin{0};
+	double boxMin[3] = {INFINITY, INFINITY, INFINITY};
+	double boxMax[3] = {-INFINITY, -INFINITY, -INFINITY};
+	double nearestDistance = INFINITY;
+	size_t star = 0;
+	shell.forEachStar(0, count, [&](const double px, const double py, const double pz)
+	{
+		const double position[3] = {px, py, pz};
+		double extent = 0.;
+		for (int axis = 0; axis < 3; axis++) extent = std::max(extent, std::max(boxMax[axis], position[axis]) - std::min(boxMin[axis], position[axis]));
+		const double distance = std::sqrt(px * px + py * py + pz * pz);
+		const bool isFull = star - boxBegin.back() == BOX_STAR_COUNT;
+		if (star > boxBegin.back() && (isFull || extent > MAX_BOX_EXTENT_RATIO * std::min(nearestDistance, distance)))
+		{
+			boxBegin.push_back(star);
+			std::fill(boxMin, boxMin + 3, INFINITY);
+			std::fill(boxMax, boxMax + 3, -INFINITY);
+			nearestDistance = INFINITY;
+		}
+
+		for (int axis = 0; axis < 3; axis++)
+		{
+			boxMin[axis] = std::min(boxMin[axis], position[axis]);
+			boxMax[axis] = std::max(boxMax[axis], position[axis]);
+		}
+		nearestDistance = std::min(nearestDistance, distance);
+		star++;
+	});
+	compact.boxes.resize(boxBegin.size());
+
+	const size_t taskCount = (boxBegin.size() + BOXES_PER_TASK - 1) / BOXES_PER_TASK;
+	Parallel::forEach(taskCount, [&](const size_t task)
+	{
+		for (size_t box = task * BOXES_PER_TASK; box < std::min(boxBegin.size(), (task + 1) * BOXES_PER_TASK); box++)
+		{
+			const size_t first = boxBegin[box];
+			const size_t last = box + 1 < boxBegin.size() ? boxBegin[box + 1] : count;
+
+			double minX = INFINITY, minY = INFINITY, minZ = INFINITY;
+			double maxX = -INFINITY, maxY = -INFINITY, maxZ = -INFINITY;
+			shell.forEachStar(first, last, [&](const double px, const double py, const double pz)
+			{
+				minX = std::min(minX, px);
+				minY = std::min(minY, py);
+				minZ = std::min(minZ, pz);
+				maxX = std::max(maxX, px);
+				maxY = std::max(maxY, py);
+				maxZ = std::max(maxZ, pz);
+			});
+
+			//Smallest power of two step that spans the box in GRID_MAX steps
+			const double extent = std::max({maxX - minX, maxY - minY, maxZ - minZ});
+			int exponent = MIN_GRID_EXPONENT;
+			if (extent > 0.) exponent = std::clamp(int(std::ceil(std::log2(extent / GRID_MAX))), MIN_GRID_EXPONENT, MAX_GRID_EXPONENT);
+			while (exponent < MAX_GRID_EXPONENT && std::ldexp(double(GRID_MAX), exponent) < extent) exponent++;
+
+			compact.boxes[box] = {minX, minY, minZ, first, int8_t(exponent)};
+			const double inverseStep = std::ldexp(1., -exponent);
+			auto quantize = [&](const double offset) { return uint16_t(std::min<double>(GRID_MAX, std::round(offset * inverseStep))); };
+			size_t i = first;
+			shell.forEachStar(first, last, [&](const double px, const double py, const double pz)
+			{
+				compact.x[i] = quantize(px - minX);
+				compact.y[i] = quantize(py - minY);
+				compact.z[i] = quantize(pz - minZ);
+				i++;
+			});
+		}
+	});
+	return compact;
+}
+
+void CompactShell::decode(StarShell& outShell) const
+{
+	outShell.x.resize(size());
+	outShell.y.resize(size());
+	outShell.z.resize(size());
+	outShell.anchors.clear();
+	for (const CompactBox& box : boxes) outShell.anchors.push_back({box.x, box.y, box.z, box.begin});
+
+	forEachBox(0, size(), [&](const CompactBox& box, const size_t first, const size_t last)
+	{
+		const float step = std::ldexp(1.f, box.exponent);
+		for (size_t i = first; i < last; i++)
+		{
+			outShell.x[i] = float(x[i]) * step;
+			outShell.y[i] = float(y[i]) * step;
+			outShell.z[i] = float(z[i]) * step;
+		}
+	});
+}
+
+void StarCatalog::clear()
+{
+	_shells.clear();
+	_compactShells.clear();
+	_starCount = 0;
+}
+
+void StarCatalog::addShell(StarShell&& shell)
+{
+	_starCount += shell.size();
+	_shells.push_back(std::move(shell));
+}
+
+void StarCatalog::addShell(CompactShell&& shell)
+{
+	_starCount += shell.size();
+	_compactShells.push_back(std::move(shell));
+}
@@ -0,0 +1,207 @@
+#pragma once
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+
+//Double precision origin of the stars from begin up to the next anchor, their positions are float offsets from it.
+//Far clusters keep their offsets small, so float spacing stays well below STELLAR_RADIUS at any depth
+struct StarAnchor
+{
+	double x = 0.;
+	double y = 0.;
+	double z = 0.;
+	uint64_t begin = 0;
+};
+
+//Structure-of-arrays storage for the stars of a single shell/level
+struct StarShell
+{
+	std::vector<float> x;
+	std::vector<float> y;
+	std::vector<float> z;
+	//Empty when the positions are relative to the observer, otherwise the first anchor begins at 0
+	std::vector<StarAnchor> anchors;
+
+	//Stars each stored star stands for, above 1 for a sampled shell
+	double weight = 1.;
+	//Variance of the shell's flux estimate, 0 unless the generator estimates it
+	double fluxVariance = 0.;
+
+	size_t size() const { return x.size(); };
+	bool empty() const { return x.empty(); };
+	void reserve(const size_t count);
+	void append(const float px, const float py, const float pz);
+	//Stars appended from now on are offsets from this point
+	void anchor(const double ax, const double ay, const double az);
+	void clear();
+
+	//Orders the stars by increasing distance from the origin, anchored stars get new anchors along the order
+	void sortByDistance();
+
+	double distance(const size_t index) const;
+};
+
+//Read-only positions of a shell, owned by a StarShell or a mapped catalog file
+struct StarShellView
+{
+	const float* x = nullptr;
+	const float* y = nullptr;
+	const float* z = nullptr;
+	size_t count = 0;
+	const StarAnchor* anchors = nullptr;
+	size_t anchorCount = 0;
+
+	StarShellView() = default;
+	StarShellView(const float* px, const float* py, const float* pz, const size_t starCount, const StarAnchor* starAnchors = nullptr, const size_t starAnchorCount = 0) : x(px), y(py), z(pz), count(starCount), anchors(starAnchors), anchorCount(starAnchorCount) {};
+	StarShellView(const StarShell& shell) : x(shell.x.data()), y(shell.y.data()), z(shell.z.data()), count(shell.size()), anchors(shell.anchors.data()), anchorCount(shell.anchors.size()) {};
+
+	size_t size() const { return count; };
+	bool empty() const { return count == 0; };
+
+	//Calls fn(anchor, first, last) for every run of the stars in [begin, end) sharing an anchor, in order
+	template<typename Fn>
+	void forEachSegment(const size_t begin, const size_t end, Fn&& fn) const
+	{
+		if (anchorCount == 0)
+		{
+			if (begin < end) fn(StarAnchor(), begin, end);
+			return;
+		}
+
+		size_t segment = size_t(std::upper_bound(anchors, anchors + anchorCount, uint64_t(begin), [](const uint64_t star, const StarAnchor& anchor) { return star < anchor.begin; }) - anchors) - 1;
+		for (; segment < anchorCount && anchors[segment].begin < end; segment++)
+		{
+			const size_t first = std::max(begin, size_t(anchors[segment].begin));
+			const size_t last = std::min(end, segment + 1 < anchorCount ? size_t(anchors[segment + 1].begin) : count);
+			if (first < last) fn(anchors[segment], first, last);
+		}
+	}
+
+	//Calls fn(x, y, z) with the position relative to the observer of every star in [begin, end), in order
+	template<typename Fn>
+	void forEachStar(const size_t begin, const size_t end, Fn&& fn) const
+	{
+		forEachSegment(begin, end, [&](const StarAnchor& anchor, const size_t first, const size_t last)
+		{
+			for (size_t i = first; i < last; i++) fn(anchor.x + x[i], anchor.y + y[i], anchor.z + z[i]);
+		});
+	}
+
+	//Position relative to the observer
+	void position(const size_t index, double& outX, double& outY, double& outZ) const
+	{
+		outX = x[index];
+		outY = y[index];
+		outZ = z[index];
+		if (anchorCount == 0) return;
+
+		forEachSegment(index, index + 1, [&](const StarAnchor& anchor, size_t, size_t)
+		{
+			outX += anchor.x;
+			outY += anchor.y;
+			outZ += anchor.z;
+		});
+	}
+
+	double distance(const size_t index) const
+	{
+		double px, py, pz;
+		position(index, px, py, pz);
+		return std::sqrt(px * px + py * py + pz * pz);
+	}
+};
+
+inline double StarShell::distance(const size_t index) const
+{
+	if (anchors.empty()) return std::sqrt(double(x[index]) * x[index] + double(y[index]) * y[index] + double(z[index]) * z[index]);
+	return StarShellView(*this).distance(index);
+}
+
+//Corner of a box of consecutive stars relative to the observer, the stars lie on a grid of 2^exponent pc from it
+struct CompactBox
+{
+	double x = 0.;
+	double y = 0.;
+	double z = 0.;
+	uint64_t begin = 0;
+	int8_t exponent = 0;
+};
+
+//Stars of a shell as 16 bit grid coordinates within boxes of up to BOX_STAR_COUNT consecutive stars, half the size of float positions.
+//Grid offsets are exact in float, so decoding and the flux kernel see the same positions
+struct CompactShell
+{
+	static constexpr size_t BOX_STAR_COUNT = 4096;
+	static constexpr uint32_t GRID_MAX = UINT16_MAX;
+
+	std::vector<uint16_t> x;
+	std::vector<uint16_t> y;
+	std::vector<uint16_t> z;
+	std::vector<CompactBox> boxes;
+
+	size_t size() const { return x.size(); };
+	bool empty() const { return x.empty(); };
+
+	//Anchored stars only share a box with stars of neighbouring anchors
+	static CompactShell encode(const StarShellView& shell);
+	//Replaces the positions of a shell with the grid positions, anchored at the box corners. Weight and variance are kept
+	void decode(StarShell& outShell) const;
+
+	//Calls fn(box, first, last) for every run of the stars in [begin, end) sharing a box, in order
+	template<typename Fn>
+	void forEachBox(const size_t begin, const size_t end, Fn&& fn) const
+	{
+		size_t box = size_t(std::upper_bound(boxes.begin(), boxes.end(), uint64_t(begin), [](const uint64_t star, const CompactBox& compactBox) { return star < compactBox.begin; }) - boxes.begin());
+		for (box = box > 0 ? box - 1 : 0; box < boxes.size() && boxes[box].begin < end; box++)
+		{
+			const size_t first = std::max(begin, size_t(boxes[box].begin));
+			const size_t last = std::min(end, box + 1 < boxes.size() ? size_t(boxes[box + 1].begin) : size());
+			if (first < last) fn(boxes[box], first, last);
+		}
+	}
+
+	//Calls fn(x, y, z) with the position relative to the observer of every star in [begin, end), in order
+	template<typename Fn>
+	void forEachStar(const size_t begin, const size_t end, Fn&& fn) const
+	{
+		forEachBox(begin, end, [&](const CompactBox& box, const size_t first, const size_t last)
+		{
+			const double step = std::ldexp(1., box.exponent);
+			for (size_t i = first; i < last; i++) fn(box.x + x[i] * step, box.y + y[i] * step, box.z + z[i] * step);
+		});
+	}
+};
+
+//Receives the shells/levels in order as a generator produces them
+class ShellSink
+{
+public:
+	virtual ~ShellSink() = default;
+
+	virtual void addShell(StarShell&& shell) = 0;
+};
+
+//Holds either float shells or compact shells, depending on which addShell() is used
+class StarCatalog : public ShellSink
+{
+public:
+	void clear();
+	virtual void addShell(StarShell&& shell) override;
+	void addShell(CompactShell&& shell);
+
+	int shellCount() const { return int(_shells.size() + _compactShells.size()); };
+	size_t starCount() const { return _starCount; };
+	bool isCompact() const { return !_compactShells.empty(); };
+
+	const StarShell& shell(const int index) const { return _shells[index]; };
+	StarShell& shell(const int index) { return _shells[index]; };
+	const CompactShell& compactShell(const int index) const { return _compactShells[index]; };
+
+private:
+	std::vector<StarShell> _shells;
+	std::vector<CompactShell> _compactShells;
+	size_t _starCount = 0;
+};
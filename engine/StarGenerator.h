@@ -0,0 +1,14 @@
+#pragma once
+
+#include "Frustum.h"
+#include "StarCatalog.h"
+#include "TaskScheduler.h"
+
+class StarGenerator
+{
+public:
+	virtual ~StarGenerator() = default;
+
+	//Generates the shells/levels from firstShell on in order, keeping only the stars inside the frustum. Stops early when cancelled
+	virtual void generate(const Frustum& frustum, ShellSink& outShells, const int firstShell, const CancellationToken& cancellation) = 0;
+};
@@ -0,0 +1,195 @@
+#include "TaskScheduler.h"
+
+#include <algorithm>
+#include <string>
+
+#include "Trace.h"
+
+struct Task
+{
+	std::function<void()> function;
+
+	//Unfinished dependencies, plus one held by submit() until the task is fully registered
+	std::atomic<int> pendingDependencies{1};
+
+	std::mutex mutex;
+	bool done = false;
+	std::vector<TaskHandle> dependents;
+};
+
+//Index of the worker owned by the current thread, -1 outside the pool
+static thread_local int currentWorkerIndex = -1;
+static thread_local const TaskScheduler* currentScheduler = nullptr;
+
+TaskScheduler& TaskScheduler::instance()
+{
+	static TaskScheduler scheduler(std::max(1u, std::thread::hardware_concurrency()));
+	return scheduler;
+}
+
+TaskScheduler::TaskScheduler(const int workerCount)
+{
+	for (int i = 0; i < std::max(workerCount, 1); i++) _workers.push_back(std::make_unique<Worker>());
+	for (int i = 0; i < int(_workers.size()); i++) _workers[i]->thread = std::thread(&TaskScheduler::workerLoop, this, i);
+}
+
+TaskScheduler::~TaskScheduler()
+{
+	{
+		std::lock_guard<std::mutex> lock(_sleepMutex);
+		_stopping = true;
+	}
+	_wakeCondition.notify_all();
+	for (const std::unique_ptr<Worker>& worker : _workers) worker->thread.join();
+}
+
+TaskHandle TaskScheduler::submit(std::function<void()> function, const std::vector<TaskHandle>& dependencies)
+{
+	auto task = std::make_shared<Task>();
+	task->function = std::move(function);
+
+	for (const TaskHandle& dependency : dependencies)
+	{
+		if (!dependency) continue;
+		std::lock_guard<std::mutex> lock(dependency->mutex);
+		if (dependency->done) continue;
+		task->pendingDependencies++;
+		dependency->dependents.push_back(task);
+	}
+
+	if (--task->pendingDependencies == 0) schedule(task);
+	return task;
+}
+
+void TaskScheduler::schedule(const TaskHandle& task)
+{
+	//Counted before it's visible, so a thief can never take the count below zero
+	_queuedCount++;
+	if (currentScheduler == this)
+	{
+		Worker& worker = *_workers[currentWorkerIndex];
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		worker.tasks.push_back(task);
+	}
+	else
+	{
+		std::lock_guard<std::mutex> lock(_injectionMutex);
+		_injectionQueue.push_back(task);
+	}
+
+	{
+		//Empty critical section, a worker can't miss the wakeup between checking the queue and sleeping
+		std::lock_guard<std::mutex> lock(_sleepMutex);
+	}
+	_wakeCondition.notify_one();
+}
+
+void TaskScheduler::run(const TaskHandle& task)
+{
+	task->function();
+	task->function = nullptr;
+
+	std::vector<TaskHandle> dependents;
+	{
+		std::lock_guard<std::mutex> lock(task->mutex);
+		task->done = true;
+		dependents.swap(task->dependents);
+	}
+	for (const TaskHandle& dependent : dependents)
+	{
+		if (--dependent->pendingDependencies == 0) schedule(dependent);
+	}
+
+	//Wake threads blocked in wait()
+	{
+		std::lock_guard<std::mutex> lock(_sleepMutex);
+	}
+	_wakeCondition.notify_all();
+}
+
+TaskHandle TaskScheduler::findTask(const int workerIndex)
+{
+	if (_queuedCount == 0) return nullptr;
+
+	//Own deque, newest first
+	if (workerIndex >= 0)
+	{
+		Worker& worker = *_workers[workerIndex];
+		std::lock_guard<std::mutex> lock(worker.mutex);
+		if (!worker.tasks.empty())
+		{
+			TaskHandle task = std::move(worker.tasks.back());
+			worker.tasks.pop_back();
+			_queuedCount--;
+			return task;
+		}
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(_injectionMutex);
+		if (!_injectionQueue.empty())
+		{
+			TaskHandle task = std::move(_injectionQueue.front());
+			_injectionQueue.pop_front();
+			_queuedCount--;
+			return task;
+		}
+	}
+
+	//Steal the oldest task of another worker
+	const int workerCount = int(_workers.size());
+	for (int offset = 1; offset <= workerCount; offset++)
+	{
+		Worker& victim = *_workers[(std::max(workerIndex, 0) + offset) % workerCount];
+		std::lock_guard<std::mutex> lock(victim.mutex);
+		if (victim.tasks.empty()) continue;
+		TaskHandle task = std::move(victim.tasks.front());
+		victim.tasks.pop_front();
+		_queuedCount--;
+		return task;
+	}
+
+	return nullptr;
+}
+
+void TaskScheduler::workerLoop(const int workerIndex)
+{
+	currentWorkerIndex = workerIndex;
+	currentScheduler = this;
+	Trace::setThreadName("worker " + std::to_string(workerIndex));
+
+	while (true)
+	{
+		if (TaskHandle task = findTask(workerIndex))
+		{
+			run(task);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(_sleepMutex);
+		_wakeCondition.wait(lock, [this]{ return _stopping || _queuedCount > 0; });
+		if (_stopping) return;
+	}
+}
+
+void TaskScheduler::wait(const TaskHandle& task)
+{
+	const int workerIndex = currentScheduler == this ? currentWorkerIndex : -1;
+	while (!isDone(task))
+	{
+		if (TaskHandle other = findTask(workerIndex))
+		{
+			run(other);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(_sleepMutex);
+		_wakeCondition.wait(lock, [&]{ return _queuedCount > 0 || isDone(task); });
+	}
+}
+
+bool TaskScheduler::isDone(const TaskHandle& task)
+{
+	std::lock_guard<std::mutex> lock(task->mutex);
+	return task->done;
+}
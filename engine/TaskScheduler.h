@@ -0,0 +1,69 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
+//Shared cancellation flag, copies observe the same state. Long running tasks poll it between chunks of work
+class CancellationToken
+{
+public:
+	CancellationToken() : _cancelled(std::make_shared<std::atomic<bool>>(false)) {};
+
+	void cancel() { *_cancelled = true; };
+	bool isCancelled() const { return *_cancelled; };
+
+private:
+	std::shared_ptr<std::atomic<bool>> _cancelled;
+};
+
+struct Task;
+using TaskHandle = std::shared_ptr<Task>;
+
+//Persistent work-stealing thread pool. Each worker owns a deque, pops its own tasks LIFO and steals FIFO from the others.
+//Tasks only become runnable once all their dependencies have finished
+class TaskScheduler
+{
+public:
+	static TaskScheduler& instance();
+
+	explicit TaskScheduler(const int workerCount);
+	~TaskScheduler();
+
+	int workerCount() const { return int(_workers.size()); };
+
+	TaskHandle submit(std::function<void()> function, const std::vector<TaskHandle>& dependencies = {});
+
+	//Runs other tasks while waiting, so it may be called from inside a task
+	void wait(const TaskHandle& task);
+	static bool isDone(const TaskHandle& task);
+
+private:
+	struct Worker
+	{
+		std::thread thread;
+		std::mutex mutex;
+		std::deque<TaskHandle> tasks;
+	};
+
+	void schedule(const TaskHandle& task);
+	void run(const TaskHandle& task);
+	TaskHandle findTask(const int workerIndex);
+	void workerLoop(const int workerIndex);
+
+	std::vector<std::unique_ptr<Worker>> _workers;
+
+	//Tasks submitted from outside the pool
+	std::mutex _injectionMutex;
+	std::deque<TaskHandle> _injectionQueue;
+
+	std::mutex _sleepMutex;
+	std::condition_variable _wakeCondition;
+	std::atomic<size_t> _queuedCount{0};
+	bool _stopping = false;
+};
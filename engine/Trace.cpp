@@ -0,0 +1,150 @@
+#include "Trace.h"
+
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+
+namespace
+{
+	struct TraceEvent
+	{
+		const char* name;
+		const char* category;
+		int64_t start;
+		int64_t end;
+	};
+
+	//Written by the owning thread only, count is published with release so readers never see a half written event
+	struct TraceChunk
+	{
+		static constexpr size_t CAPACITY = 4096;
+
+		TraceEvent events[CAPACITY];
+		std::atomic<size_t> count{0};
+		std::atomic<TraceChunk*> next{nullptr};
+	};
+
+	struct ThreadBuffer
+	{
+		int threadId = 0;
+		std::string name;
+		TraceChunk* first = nullptr;
+		TraceChunk* last = nullptr;
+		std::vector<std::unique_ptr<TraceChunk>> chunks;
+	};
+
+	//Buffers outlive their threads so spans of finished workers are still written
+	std::mutex registryMutex;
+	std::vector<std::unique_ptr<ThreadBuffer>> registry;
+
+	//Buffers are only allocated once a thread records its first span
+	thread_local ThreadBuffer* currentBuffer = nullptr;
+	thread_local std::string currentThreadName;
+
+	ThreadBuffer& threadBuffer()
+	{
+		ThreadBuffer*& buffer = currentBuffer;
+		if (buffer) return *buffer;
+
+		std::lock_guard<std::mutex> lock(registryMutex);
+		auto newBuffer = std::make_unique<ThreadBuffer>();
+		newBuffer->threadId = int(registry.size()) + 1;
+		newBuffer->name = currentThreadName;
+		newBuffer->chunks.push_back(std::make_unique<TraceChunk>());
+		newBuffer->first = newBuffer->last = newBuffer->chunks.back().get();
+		buffer = newBuffer.get();
+		registry.push_back(std::move(newBuffer));
+		return *buffer;
+	}
+
+	const std::chrono::steady_clock::time_point epoch = std::chrono::steady_clock::now();
+
+	void writeEscaped(std::ostream& stream, const std::string& text)
+	{
+		for (const char c : text)
+		{
+			if (c == '"' || c == '\\') stream << '\\' << c;
+			else if (static_cast<unsigned char>(c) < 0x20) stream << ' ';
+			else stream << c;
+		}
+	}
+}
+
+std::atomic<bool> Trace::Detail::enabled{false};
+
+void Trace::setEnabled(const bool enabled)
+{
+	Detail::enabled.store(enabled, std::memory_order_relaxed);
+}
+
+int64_t Trace::now()
+{
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void Trace::addSpan(const char* name, const char* category, const int64_t start, const int64_t end)
+{
+	ThreadBuffer& buffer = threadBuffer();
+	TraceChunk* chunk = buffer.last;
+	size_t count = chunk->count.load(std::memory_order_relaxed);
+	if (count == TraceChunk::CAPACITY)
+	{
+		//Only the owner touches the chunk list, write() follows the published next pointers
+		buffer.chunks.push_back(std::make_unique<TraceChunk>());
+		TraceChunk* newChunk = buffer.chunks.back().get();
+		chunk->next.store(newChunk, std::memory_order_release);
+		buffer.last = chunk = newChunk;
+		count = 0;
+	}
+
+	chunk->events[count] = {name, category, start, end};
+	chunk->count.store(count + 1, std::memory_order_release);
+}
+
+void Trace::setThreadName(const std::string& name)
+{
+	currentThreadName = name;
+	if (!currentBuffer) return;
+
+	std::lock_guard<std::mutex> lock(registryMutex);
+	currentBuffer->name = name;
+}
+
+bool Trace::write(const std::string& path)
+{
+	std::ofstream file(path, std::ios::trunc);
+	if (!file) return false;
+
+	std::lock_guard<std::mutex> lock(registryMutex);
+	file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	bool first = true;
+	file << std::fixed << std::setprecision(3);
+	for (const std::unique_ptr<ThreadBuffer>& buffer : registry)
+	{
+		if (!buffer->name.empty())
+		{
+			file << (first ? "" : ",") << "\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->threadId << ",\"args\":{\"name\":\"";
+			writeEscaped(file, buffer->name);
+			file << "\"}}";
+			first = false;
+		}
+
+		for (const TraceChunk* chunk = buffer->first; chunk; chunk = chunk->next.load(std::memory_order_acquire))
+		{
+			const size_t count = chunk->count.load(std::memory_order_acquire);
+			for (size_t i = 0; i < count; i++)
+			{
+				//Complete events, timestamps in microseconds
+				const TraceEvent& event = chunk->events[i];
+				file << (first ? "" : ",") << "\n{\"name\":\"" << event.name << "\",\"cat\":\"" << event.category << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buffer->threadId
+					 << ",\"ts\":" << event.start * 1e-3 << ",\"dur\":" << (event.end - event.start) * 1e-3 << "}";
+				first = false;
+			}
+		}
+	}
+	file << "\n]}\n";
+	return bool(file);
+}
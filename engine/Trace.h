@@ -0,0 +1,50 @@
+#pragma once
+
+#include <string>
+#include <atomic>
+#include <cstdint>
+
+//Scoped-span tracer writing Chrome trace event JSON, opens in Perfetto and chrome://tracing.
+//Every thread appends to its own buffer without locking, a disabled tracer only costs a relaxed atomic load per span.
+//Names and categories must be string literals, they are stored as pointers
+namespace Trace
+{
+	namespace Detail
+	{
+		extern std::atomic<bool> enabled;
+	}
+
+	inline bool isEnabled() { return Detail::enabled.load(std::memory_order_relaxed); };
+	void setEnabled(const bool enabled);
+
+	//Nanoseconds since the first use of the tracer
+	int64_t now();
+
+	//Records a span that isn't bound to a scope, e.g. one ending in a callback
+	void addSpan(const char* name, const char* category, const int64_t start, const int64_t end);
+	//Shown instead of the thread id, the string is copied
+	void setThreadName(const std::string& name);
+
+	//Writes every recorded span, can be called while threads keep tracing. Returns false if the file can't be written
+	bool write(const std::string& path);
+}
+
+class TraceSpan
+{
+public:
+	TraceSpan(const char* name, const char* category) : _name(name), _category(category), _start(Trace::isEnabled() ? Trace::now() : -1) {};
+	~TraceSpan() { if (_start >= 0) Trace::addSpan(_name, _category, _start, Trace::now()); };
+
+	TraceSpan(const TraceSpan&) = delete;
+	TraceSpan& operator=(const TraceSpan&) = delete;
+
+private:
+	const char* _name;
+	const char* _category;
+	int64_t _start;
+};
+
+#define OLBERS_TRACE_CONCAT_IMPL(a, b) a##b
+#define OLBERS_TRACE_CONCAT(a, b) OLBERS_TRACE_CONCAT_IMPL(a, b)
+//Traces the rest of the enclosing scope
+#define OLBERS_TRACE_SCOPE(name, category) TraceSpan OLBERS_TRACE_CONCAT(traceSpan, __LINE__)(name, category)
@@ -0,0 +1,50 @@
+# Headless simulation engine, shared by the GUI, the CLI and the engine library target.
+# Only depends on the C++ standard library.
+
+INCLUDEPATH += $$PWD $$PWD/..
+DEPENDPATH += $$PWD
+CONFIG += thread
+
+HEADERS += \
+	$$PWD/CatalogFile.h \
+	$$PWD/Checkpoint.h \
+	$$PWD/Estimator.h \
+	$$PWD/FluxAccumulator.h \
+	$$PWD/FluxKernel.h \
+	$$PWD/FractalGenerator.h \
+	$$PWD/Frustum.h \
+	$$PWD/HalleyGenerator.h \
+	$$PWD/OcclusionBuffer.h \
+	$$PWD/Parallel.h \
+	$$PWD/Photometry.h \
+	$$PWD/Random.h \
+	$$PWD/SightLines.h \
+	$$PWD/SimulationEngine.h \
+	$$PWD/SimulationParameters.h \
+	$$PWD/SkyMap.h \
+	$$PWD/Simd.h \
+	$$PWD/StarCatalog.h \
+	$$PWD/StarGenerator.h \
+	$$PWD/TaskScheduler.h \
+	$$PWD/Trace.h
+
+SOURCES += \
+	$$PWD/CatalogFile.cpp \
+	$$PWD/Checkpoint.cpp \
+	$$PWD/Estimator.cpp \
+	$$PWD/FluxAccumulator.cpp \
+	$$PWD/FluxKernel.cpp \
+	$$PWD/FractalGenerator.cpp \
+	$$PWD/Frustum.cpp \
+	$$PWD/HalleyGenerator.cpp \
+	$$PWD/OcclusionBuffer.cpp \
+	$$PWD/Parallel.cpp \
+	$$PWD/Photometry.cpp \
+	$$PWD/Random.cpp \
+	$$PWD/SightLines.cpp \
+	$$PWD/SimulationEngine.cpp \
+	$$PWD/Simd.cpp \
+	$$PWD/SkyMap.cpp \
+	$$PWD/StarCatalog.cpp \
+	$$PWD/TaskScheduler.cpp \
+	$$PWD/Trace.cpp
@@ -0,0 +1,7 @@
+TEMPLATE = lib
+TARGET = OlbersEngine
+
+CONFIG += staticlib c++17
+CONFIG -= qt
+
+include(engine.pri)
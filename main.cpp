@@ -2,10 +2,27 @@
 
 #include <QApplication>
 
+#include "Trace.h"
+
 int main(int argc, char *argv[])
 {
 	QApplication a(argc, argv);
+	//Settings keep the measured throughput between runs
+	QApplication::setOrganizationName("WhenInDoubtC4");
+	QApplication::setApplicationName("OlbersParadoxSimulation");
+
+	//Chrome trace of the whole session, written on exit
+	const QString tracePath = qEnvironmentVariable("OLBERS_TRACE");
+	if (!tracePath.isEmpty())
+	{
+		Trace::setThreadName("GUI");
+		Trace::setEnabled(true);
+	}
+
 	MainWindow w;
 	w.show();
-	return a.exec();
+	const int result = a.exec();
+
+	if (!tracePath.isEmpty() && !Trace::write(tracePath.toStdString())) qWarning("Unable to write \"%s\"", qPrintable(tracePath));
+	return result;
 }
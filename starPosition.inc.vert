@@ -0,0 +1,18 @@
+// Center of a star instance. Compact instances hold an octahedral direction and the log of the scaled distance, 16 bits each
+
+uniform bool compactPositions;
+uniform float logDistanceMin;
+uniform float logDistanceStep;
+
+vec3 starPosition(vec3 pos, float scale)
+{
+	if (!compactPositions) return pos * scale;
+
+	// Unsigned shorts arrive unnormalized, from 0 to 65535
+	vec2 octahedral = pos.xy / 65535.0 * 2.0 - 1.0;
+	vec3 direction = vec3(octahedral, 1.0 - abs(octahedral.x) - abs(octahedral.y));
+	float fold = max(-direction.z, 0.0);
+	direction.x += direction.x >= 0.0 ? -fold : fold;
+	direction.y += direction.y >= 0.0 ? -fold : fold;
+	return normalize(direction) * exp(logDistanceMin + pos.z * logDistanceStep);
+}